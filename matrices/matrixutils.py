@@ -2,6 +2,7 @@
 
 import io, numpy, scipy, struct, os
 from scipy import io as ios
+from scipy import sparse
 from copy import deepcopy
 import matplotlib.pyplot as plot
 import urllib, tarfile
@@ -28,7 +29,8 @@ def prepareTestSuite():
 
 # given the full name of a University of Florida matrix; download, extract and 
 # convert the matrix to the form expected by the accelerator
-def prepareUFLMatrix(name):
+# if symmetric is set, symmetric matrices are stored as one triangle
+def prepareUFLMatrix(name, symmetric=False):
     f = urllib.URLopener()
     url="http://www.cise.ufl.edu/research/sparse/MM/"+name+".tar.gz"    
     name=name.split("/")[1]
@@ -51,7 +53,7 @@ def prepareUFLMatrix(name):
     # convert if the destination dir doest not exist
     if not os.path.exists(outputBase+"/"+name):
         A=loadMatrix(name)
-        convertMatrix(A, name)
+        convertMatrix(A, name, symmetric=(symmetric and isSymmetric(A)))
         makeGoldenResult(A, name)
 
 # apply fxn to every member of A.data to convert the NZ data value types
@@ -92,12 +94,32 @@ def loadAndConvertMatrix(name, startAddr=dramBase):
     A=loadMatrix(name)
     return convertMatrix(A, name, startAddr)
 
+# flags in the metadata file
+# symmetric: only the lower triangle and the diagonal are stored
+flagSymmetric = 1
+
+def isSymmetric(A):
+  if A.shape[0] != A.shape[1]:
+    return False
+  return (A != A.transpose()).nnz == 0
+
 # read in a matrix, convert it to separate CSC SpMV data files + output
 # command info (for reading this from an SD card later)
-def convertMatrix(A, name, startAddr=dramBase):
+# if patternOnly is set, no nz values are written (bytesPerVal = 0) and the
+# values are implicitly the semiring one
+# if symmetric is set, only the lower triangle of the (symmetric) matrix is
+# written, which roughly halves the matrix size
+def convertMatrix(A, name, startAddr=dramBase, patternOnly=False, symmetric=False):
   if A.format != "csc":
     print "Matrix must be in CSC format! Converting.."
     A = A.tocsc()
+  flags = 0
+  if symmetric:
+    if not isSymmetric(A):
+      raise Exception("Matrix is not symmetric: " + name)
+    A = sparse.tril(A).tocsc()
+    A.sort_indices()
+    flags = flags | flagSymmetric
     
   startingRow=0
   startingCol=0
@@ -110,11 +132,18 @@ def convertMatrix(A, name, startAddr=dramBase):
   metaDataFile = io.open(fileName, "wb")
   metaDataFile.write(struct.pack("I", A.shape[0]))
   metaDataFile.write(struct.pack("I", A.shape[1]))
-  metaDataFile.write(struct.pack("I", A.nnz))
+  # nz is 64-bit to allow more than 4G nonzeros
+  metaDataFile.write(struct.pack("Q", A.nnz))
   metaDataFile.write(struct.pack("I", startingRow))
   metaDataFile.write(struct.pack("I", startingCol))
   metaDataFile.write(struct.pack("I", A.indices[0].nbytes))
-  metaDataFile.write(struct.pack("I", A.data[0].nbytes))
+  if patternOnly:
+    metaDataFile.write(struct.pack("I", 0))
+  else:
+    metaDataFile.write(struct.pack("I", A.data[0].nbytes))
+  metaDataFile.write(struct.pack("I", flags))
+  # reserved
+  metaDataFile.write(struct.pack("I", 0))
   metaDataFile.close()
 
   
@@ -131,10 +160,11 @@ def convertMatrix(A, name, startAddr=dramBase):
   indsFile.close()
   
   # nz values
-  fileName = targetDir + "/" + name + "-nzdata.bin"
-  indsFile = io.open(fileName, "wb")
-  indsFile.write(A.data.tostring())
-  indsFile.close()  
+  if not patternOnly:
+    fileName = targetDir + "/" + name + "-nzdata.bin"
+    indsFile = io.open(fileName, "wb")
+    indsFile.write(A.data.tostring())
+    indsFile.close()
   
   print "Rows = " + str(A.shape[0])
   print "Cols = " + str(A.shape[1])
@@ -0,0 +1,145 @@
+#!/bin/sh
+# build emulators for Seyrek accelerators and check their SpMV results
+# against the software golden computed by main.cpp.
+# usage (from the repository root): scripts/emu-validate.sh [test ...]
+# runs all tests if none are given. needs sbt and a C++ compiler, the
+# emulators are built into emu/<accel>.
+
+set -e
+
+ALL_TESTS="hazard cached coalesce multipe wide pattern selectable jobs"
+CXX=${CXX:-g++}
+EMU_ROOT=emu
+
+# extra flags for building main.cpp for the accelerator in $1
+accel_cxxflags() {
+  case $1 in
+    UInt32*) echo "-DSEYREK_VAL32" ;;
+  esac
+}
+
+# build the emulator and main.cpp for the accelerator in $1, unless built
+build_emu() {
+  accel=$1
+  if [ -x $EMU_ROOT/$accel/main ]; then return 0; fi
+  rm -rf emulator
+  sbt "run emulator $accel Tester"
+  mkdir -p $EMU_ROOT/$accel
+  $CXX -O2 -std=c++11 $CXXFLAGS $(accel_cxxflags $accel) -Iemulator -o $EMU_ROOT/$accel/main \
+    emulator/main.cpp emulator/seyrek-tester.cpp emulator/platform-tester.cpp \
+    emulator/TesterWrapper*.cpp
+}
+
+# run main for the accelerator in $1 with the stdin answers in $2 and the
+# command line arguments in the rest, pass if the result matches the golden
+run_emu() {
+  accel=$1
+  input=$2
+  shift 2
+  build_emu $accel
+  printf '== %s: %s %s\n' "$accel" "$input" "$*"
+  log=$EMU_ROOT/$accel/last.log
+  if printf "$input" | $EMU_ROOT/$accel/main "$@" > $log 2>&1 &&
+     grep -q "memcmp result: 0" $log; then
+    echo "PASS"
+  else
+    tail -n 20 $log
+    echo "FAIL"
+    FAILED="$FAILED $accel"
+  fi
+}
+
+# hazard-aware nonzero reordering with the out-of-order dispatch scheduler
+# (external context memory), and with the in-order one. small dense
+# matrices revisit each row after only a few nonzeros, so they hazard
+# without reordering.
+test_hazard() {
+  run_emu UInt64ExtOoOD "dense\n8\nx\n" -e
+  run_emu UInt64ExtOoOD "dense\n8\nx\n" -e -r 32,12
+  run_emu UInt64ExtOoOD "dense\n100\nx\n" -e -r 32,12
+  run_emu UInt64BRAM "dense\n8\nx\n" -r 16,8
+  run_emu UInt64BRAM "eye\n500\nx\n" -r 16,8
+}
+
+# cached context memory: hits only, and more rows than cache lines so that
+# lines get evicted and written back
+test_cached() {
+  run_emu UInt64Cached "dense\n100\nx\n" -e
+  run_emu UInt64Cached "eye\n10000\nx\n" -e
+  run_emu UInt64Cached "dense\n1000\nx\n" -e
+}
+
+# same-row coalescing: long runs of nonzeros for one row (up to the whole
+# matrix), short runs, and no runs at all
+test_coalesce() {
+  run_emu UInt64BRAMCoalesce "rowruns\n1000\n16\nx\n"
+  run_emu UInt64BRAMCoalesce "rowruns\n1000\n1000\nx\n"
+  run_emu UInt64BRAMCoalesce "rowruns\n1000\n3\nx\n"
+  run_emu UInt64BRAMCoalesce "dense\n50\nx\n"
+  run_emu UInt64BRAMCoalesce "eye\n500\nx\n"
+  run_emu UInt64BRAM "rowruns\n1000\n16\nx\n"
+}
+
+# several PEs sharing the memory ports through MemPortArbiters, using all
+# of them and fewer than there are
+test_multipe() {
+  for n in 2 4 8; do
+    run_emu UInt64BRAMx$n "dense\n100\nx\n" -p $n
+    run_emu UInt64BRAMx$n "eye\n1000\nx\n" -p $n
+  done
+  run_emu UInt64BRAMx4 "dense\n100\nx\n" -p 3
+  run_emu UInt64BRAMx8 "rowruns\n1000\n16\nx\n" -p 5
+  # fewer rows than twice the PE count, every PE still gets a row
+  run_emu UInt64BRAMx8 "eye\n10\nx\n" -p 8
+  run_emu UInt64BRAMx8 "dense\n20\nx\n" -p 8
+  run_emu UInt64BRAMx8 "eye\n8\nx\n" -p 8
+}
+
+# two-lane frontend with banked context memory and 32-bit values. odd
+# nonzero counts need the lane padding, odd row counts the flush padding
+test_wide() {
+  run_emu UInt32BRAMWide "dense\n100\nx\n" -l 2
+  run_emu UInt32BRAMWide "dense\n101\nx\n" -l 2
+  run_emu UInt32BRAMWide "eye\n2047\nx\n" -l 2
+  run_emu UInt32BRAMWide "rowruns\n999\n1\nx\n" -l 2
+  run_emu UInt32BRAMWide "rowruns\n1001\n16\nx\n" -l 2
+}
+
+# pattern-only accelerator over the boolean (OR, AND) semiring, without the
+# nzdata stream. main drops the matrix values for -n
+test_pattern() {
+  run_emu UInt32BRAMPattern "dense\n100\nx\n" -n
+  run_emu UInt32BRAMPattern "eye\n1000\nx\n" -n
+  run_emu UInt32BRAMPattern "rowruns\n1000\n16\nx\n" -n
+}
+
+# runtime-selectable semiring unit, switched through semiringSel. every
+# third element of x is the semiring zero, so min-plus has unreachable
+# vertices whose sums must saturate
+test_selectable() {
+  for s in addmul minplus orand; do
+    run_emu UInt64BRAMSelectable "dense\n100\nx\n" -s $s
+    run_emu UInt64BRAMSelectable "eye\n1000\nx\n" -s $s
+  done
+  run_emu UInt64BRAMSelectable "rowruns\n1000\n16\nx\n" -s minplus
+}
+
+# descriptor-based job submission: one slot, and rings with room to spare
+test_jobs() {
+  run_emu UInt64BRAMJobs "dense\n100\nx\n" -j 4
+  run_emu UInt64BRAMJobs "eye\n1000\nx\n" -j 4
+  run_emu UInt64BRAMJobs "rowruns\n1000\n16\nx\n" -j 1
+  run_emu UInt64BRAMJobs "dense\n100\nx\n" -j 64 -r 16,8
+}
+
+FAILED=""
+TESTS=${*:-$ALL_TESTS}
+for t in $TESTS; do
+  test_$t
+done
+
+if [ -n "$FAILED" ]; then
+  echo "Failed:$FAILED"
+  exit 1
+fi
+echo "All passed"
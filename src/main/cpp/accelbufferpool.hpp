@@ -0,0 +1,117 @@
+#ifndef ACCELBUFFERPOOL_HPP
+#define ACCELBUFFERPOOL_HPP
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include <iostream>
+#include "wrapperregdriver.h"
+
+// pooled allocator on top of WrapperRegDriver::allocAccelBuffer64.
+// requests are rounded up to a size class, and released buffers are kept
+// in per-class free lists to be reused by later requests of the same class
+// instead of going back to the platform allocator.
+// size classes are powers of two up to POOL_FINE_CLASS_MIN, and four
+// classes per power of two above that (so at most 25% is wasted).
+
+#define POOL_MIN_CLASS        64
+#define POOL_FINE_CLASS_MIN   4096
+
+class AccelBufferPool {
+public:
+  AccelBufferPool(WrapperRegDriver * driver) {
+    m_platform = driver;
+    m_bytesInUse = 0;
+    m_bytesAllocated = 0;
+    m_highWaterMark = 0;
+    m_allocCalls = 0;
+    m_reuseCount = 0;
+  }
+
+  // frees all buffers, including those that were not released
+  virtual ~AccelBufferPool() {
+    trim();
+    for(std::map<void *, uint64_t>::iterator it = m_inUse.begin(); it != m_inUse.end(); ++it)
+      m_platform->deallocAccelBuffer(it->first);
+  }
+
+  void * alloc(uint64_t numBytes) {
+    uint64_t size = sizeClass(numBytes);
+    void * buf = 0;
+    m_allocCalls++;
+    std::vector<void *> & freeList = m_freeLists[size];
+    if(!freeList.empty()) {
+      buf = freeList.back();
+      freeList.pop_back();
+      m_reuseCount++;
+    } else {
+      buf = m_platform->allocAccelBuffer64(size);
+      if(!buf) {
+        // give the unused buffers of other classes back and try again
+        trim();
+        buf = m_platform->allocAccelBuffer64(size);
+      }
+      if(!buf) throw "Accelerator buffer allocation failed in AccelBufferPool";
+      m_bytesAllocated += size;
+      if(m_bytesAllocated > m_highWaterMark) m_highWaterMark = m_bytesAllocated;
+    }
+    m_inUse[buf] = size;
+    m_bytesInUse += size;
+    return buf;
+  }
+
+  // return a buffer to the pool, it stays allocated on the accelerator
+  void release(void * buffer) {
+    std::map<void *, uint64_t>::iterator it = m_inUse.find(buffer);
+    if(it == m_inUse.end()) throw "Buffer not allocated from this pool";
+    m_freeLists[it->second].push_back(buffer);
+    m_bytesInUse -= it->second;
+    m_inUse.erase(it);
+  }
+
+  // give all currently unused buffers back to the platform
+  void trim() {
+    for(std::map<uint64_t, std::vector<void *> >::iterator it = m_freeLists.begin(); it != m_freeLists.end(); ++it) {
+      for(unsigned int i = 0; i < it->second.size(); i++) {
+        m_platform->deallocAccelBuffer(it->second[i]);
+        m_bytesAllocated -= it->first;
+      }
+      it->second.clear();
+    }
+  }
+
+  uint64_t getBytesInUse() const {return m_bytesInUse;}
+  uint64_t getBytesAllocated() const {return m_bytesAllocated;}
+  uint64_t getHighWaterMark() const {return m_highWaterMark;}
+
+  void printStats() {
+    std::cout << "Accel buffer pool summary" << std::endl;
+    std::cout << "bytes in use = " << m_bytesInUse << std::endl;
+    std::cout << "bytes allocated = " << m_bytesAllocated << std::endl;
+    std::cout << "high water mark = " << m_highWaterMark << std::endl;
+    std::cout << "allocs = " << m_allocCalls << " reused = " << m_reuseCount << std::endl;
+  }
+
+  static uint64_t sizeClass(uint64_t numBytes) {
+    uint64_t size = POOL_MIN_CLASS;
+    while(size < numBytes && size < POOL_FINE_CLASS_MIN) size = size << 1;
+    if(size >= numBytes) return size;
+    // find the enclosing power of two, then round up to a quarter of it
+    uint64_t base = POOL_FINE_CLASS_MIN;
+    while(numBytes - base > base) base = base << 1;
+    uint64_t step = base / 4;
+    return base + ((numBytes - base + step - 1) / step) * step;
+  }
+
+protected:
+  WrapperRegDriver * m_platform;
+  std::map<uint64_t, std::vector<void *> > m_freeLists;
+  std::map<void *, uint64_t> m_inUse;
+  uint64_t m_bytesInUse;
+  uint64_t m_bytesAllocated;
+  uint64_t m_highWaterMark;
+  unsigned int m_allocCalls;
+  unsigned int m_reuseCount;
+};
+
+#endif // ACCELBUFFERPOOL_HPP
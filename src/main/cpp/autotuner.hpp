@@ -0,0 +1,418 @@
+#ifndef AUTOTUNER_HPP
+#define AUTOTUNER_HPP
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include "csc.hpp"
+#include "swcscspmv.hpp"
+#include "swsymcscspmv.hpp"
+#include "parallelspmv.hpp"
+#include "partitioncache.hpp"
+#include "commonsemirings.hpp"
+
+// per-matrix autotuner for the SpMV configuration. cheap structural
+// features of the matrix are used to pick a set of candidate
+// configurations (SW or HW, number of PEs, partition scheme and format,
+// hazard reordering), which are then run for a few timed trials each,
+// sweeping the outstanding context transactions for HW ones with external
+// context memory.
+// the fastest configuration is stored in a small text database, keyed by
+// the matrix name, the fingerprint of its contents (see PartitionCache) and
+// the accelerator setup (attach name, context memory and frontend lanes),
+// so later runs on the same matrix and accelerator skip the trials.
+
+typedef struct {
+  unsigned int rows;
+  unsigned int cols;
+  uint64_t nz;
+  double avgRowNZ;
+  unsigned int maxRowNZ;
+  double rowNZCoV;            // coefficient of variation of the row lengths
+  double avgColNZ;
+  unsigned int maxColNZ;
+  double emptyColFraction;
+  unsigned int bandwidth;     // largest |row - col| of any nonzero
+} MatrixFeatures;
+
+typedef struct {
+  uint32_t useHW;             // 0 for SW SpMV on the host
+  uint32_t numPEs;
+  uint32_t scheme;            // PartitionScheme
+  uint32_t format;            // PartitionFormat
+  uint32_t reorder;           // hazard-aware nonzero reordering
+  uint32_t txns;              // outstanding context transactions
+} SpMVTuneConfig;
+
+// PE counts whose equal-row partitions are more unbalanced than this
+// (largest partition nz / average) also try nnz-balanced partitions
+#define AUTOTUNE_IMBALANCE    1.1
+
+template <class SpMVInd, class SpMVVal,
+          class SpMVSemiring = AddMulSemiring<SpMVInd, SpMVVal> >
+class SpMVAutotuner {
+public:
+  typedef ParallelHWSpMV<SpMVInd, SpMVVal, SpMVSemiring> HWRunner;
+
+  SpMVAutotuner(WrapperRegDriver * driver, std::string attachName,
+                unsigned int maxPEs, std::string dbFile) {
+    if(maxPEs == 0 || maxPEs > MAX_HWSPMV_PE)
+      throw "Unsupported number of PEs in SpMVAutotuner";
+    m_platform = driver;
+    m_attachName = attachName;
+    m_maxPEs = maxPEs;
+    m_dbFile = dbFile;
+    m_cache = 0;
+    m_issueWindow = 0;
+    m_latency = 0;
+    m_trials = 3;
+    m_hwExtContext = false;
+    m_hwLanes = 1;
+  }
+
+  virtual ~SpMVAutotuner() {}
+
+  // also try hazard-aware reordering, with the scheduler parameters of
+  // the HW (see ParallelHWSpMV::setHazardReorder)
+  void setHazardModel(unsigned int issueWindow, unsigned int latency) {
+    m_issueWindow = issueWindow;
+    m_latency = latency;
+  }
+
+  // partition cache used by the HW SpMVs created by the tuner
+  void setPartitionCache(PartitionCache<SpMVInd, SpMVVal> * cache) {
+    m_cache = cache;
+  }
+
+  // set if the accelerator keeps its contexts in main memory (see
+  // HWSpMV::setHWExtContext). only those use the outstanding context
+  // transactions, so they are only swept then.
+  void setHWExtContext(bool extContext) {
+    m_hwExtContext = extContext;
+  }
+
+  // frontendLanes of the accelerator, see HWSpMV::setHWLanes
+  void setHWLanes(unsigned int lanes) {
+    m_hwLanes = lanes;
+  }
+
+  // number of timed runs per configuration, the fastest one counts
+  void setTrials(unsigned int trials) {
+    if(trials == 0) throw "trials must be nonzero in SpMVAutotuner";
+    m_trials = trials;
+  }
+
+  // return the stored configuration for A, or find it by running trials
+  // and store it
+  SpMVTuneConfig tune(CSC<SpMVInd, SpMVVal> * A) {
+    SpMVTuneConfig best;
+    uint64_t fp = PartitionCache<SpMVInd, SpMVVal>::fingerprint(A);
+    if(lookup(A->getName(), fp, best)) {
+      std::cout << "Autotuner: stored config for " << A->getName() << ": " << describe(best) << std::endl;
+      return best;
+    }
+    // the HW computes with both triangles of symmetric matrices, so the
+    // features and partition balance are taken from the expanded matrix
+    CSC<SpMVInd, SpMVVal> * fullA = A->isSymmetric() ? A->expandSymmetric() : A;
+    MatrixFeatures f = extractFeatures(fullA);
+    printFeatures(f);
+    std::vector<SpMVTuneConfig> cands = candidates(fullA, f);
+    if(fullA != A) delete fullA;
+    double bestTime = -1;
+    // the candidates come grouped by PE count. one HW runner (attached to
+    // the accelerator) is kept per PE count, and set up again with setA for
+    // each of its candidates. a HW candidate that fails is skipped, and its
+    // runner is created again for the next one.
+    CSCSpMV<SpMVInd, SpMVVal> * sw = 0;
+    HWRunner * hw = 0;
+    unsigned int hwPEs = 0;
+    try {
+      for(unsigned int i = 0; i < cands.size(); i++) {
+        if(!cands[i].useHW) {
+          sw = create(cands[i], A->isSymmetric());
+          runTrials(A, sw, cands[i], best, bestTime);
+          delete sw;
+          sw = 0;
+          continue;
+        }
+        if(hw && hwPEs != cands[i].numPEs) {
+          delete hw;
+          hw = 0;
+        }
+        try {
+          if(!hw) {
+            hw = new HWRunner(cands[i].numPEs, m_platform, m_attachName.c_str());
+            hwPEs = cands[i].numPEs;
+          }
+          configure(hw, cands[i]);
+          runTrials(A, hw, cands[i], best, bestTime);
+        } catch(char const * err) {
+          std::cout << "Autotuner: skipping " << describe(cands[i]) << ": " << err << std::endl;
+          delete hw;
+          hw = 0;
+        }
+      }
+    } catch(...) {
+      delete sw;
+      delete hw;
+      throw;
+    }
+    delete hw;
+    std::cout << "Autotuner: best config " << describe(best) << std::endl;
+    store(A->getName(), fp, best, bestTime);
+    return best;
+  }
+
+  // create and configure an SpMV for the given configuration. setA, setx
+  // and sety still have to be called, and the caller owns the result.
+  CSCSpMV<SpMVInd, SpMVVal> * create(SpMVTuneConfig c, bool symmetric) {
+    if(!c.useHW) {
+      if(symmetric) return new SWSymRunner();
+      return new SWRunner();
+    }
+    HWRunner * hw = new HWRunner(c.numPEs, m_platform, m_attachName.c_str());
+    configure(hw, c);
+    return hw;
+  }
+
+  static MatrixFeatures extractFeatures(CSC<SpMVInd, SpMVVal> * A) {
+    MatrixFeatures f;
+    f.rows = A->getRows();
+    f.cols = A->getCols();
+    f.nz = A->getNNZ();
+    f.maxRowNZ = 0;
+    f.maxColNZ = 0;
+    f.bandwidth = 0;
+    SpMVInd * colPtr = A->getIndPtrs();
+    SpMVInd * rowInds = A->getInds();
+    std::vector<uint64_t> rowCnt(f.rows, 0);
+    unsigned int emptyCols = 0;
+    for(SpMVInd col = 0; col < f.cols; col++) {
+      unsigned int colNZ = colPtr[col+1] - colPtr[col];
+      if(colNZ == 0) emptyCols++;
+      if(colNZ > f.maxColNZ) f.maxColNZ = colNZ;
+      for(SpMVInd ep = colPtr[col]; ep < colPtr[col+1]; ep++) {
+        SpMVInd row = rowInds[ep];
+        rowCnt[row]++;
+        unsigned int dist = row > col ? row - col : col - row;
+        if(dist > f.bandwidth) f.bandwidth = dist;
+      }
+    }
+    f.avgRowNZ = f.rows ? (double) f.nz / f.rows : 0;
+    f.avgColNZ = f.cols ? (double) f.nz / f.cols : 0;
+    f.emptyColFraction = f.cols ? (double) emptyCols / f.cols : 0;
+    double var = 0;
+    for(unsigned int r = 0; r < f.rows; r++) {
+      if(rowCnt[r] > f.maxRowNZ) f.maxRowNZ = rowCnt[r];
+      var += (rowCnt[r] - f.avgRowNZ) * (rowCnt[r] - f.avgRowNZ);
+    }
+    f.rowNZCoV = (f.rows && f.avgRowNZ > 0) ? sqrt(var / f.rows) / f.avgRowNZ : 0;
+    return f;
+  }
+
+  static void printFeatures(const MatrixFeatures & f) {
+    std::cout << "Matrix features: rows = " << f.rows << " cols = " << f.cols;
+    std::cout << " nz = " << f.nz << std::endl;
+    std::cout << "  row nz avg = " << f.avgRowNZ << " max = " << f.maxRowNZ;
+    std::cout << " CoV = " << f.rowNZCoV << std::endl;
+    std::cout << "  col nz avg = " << f.avgColNZ << " max = " << f.maxColNZ;
+    std::cout << " empty = " << f.emptyColFraction << std::endl;
+    std::cout << "  bandwidth = " << f.bandwidth << std::endl;
+  }
+
+  static std::string describe(SpMVTuneConfig c) {
+    std::ostringstream ss;
+    if(!c.useHW) return "SW";
+    ss << "HW PEs = " << c.numPEs;
+    ss << (c.scheme == PARTITION_NNZ_BALANCED ? " nnz-balanced" : " equal-rows");
+    ss << (c.format == PARTITION_FORMAT_DCSC ? " DCSC" : " CSC");
+    if(c.reorder) ss << " reordered";
+    ss << " txns = " << c.txns;
+    return ss.str();
+  }
+
+protected:
+  WrapperRegDriver * m_platform;
+  std::string m_attachName;
+  unsigned int m_maxPEs;
+  std::string m_dbFile;
+  PartitionCache<SpMVInd, SpMVVal> * m_cache;
+  unsigned int m_issueWindow;
+  unsigned int m_latency;
+  unsigned int m_trials;
+  bool m_hwExtContext;
+  unsigned int m_hwLanes;
+
+  // set up hw for the configuration, before setA
+  void configure(HWRunner * hw, SpMVTuneConfig c) {
+    hw->setPartitionScheme((PartitionScheme) c.scheme);
+    hw->setHypersparse(c.format == PARTITION_FORMAT_DCSC);
+    hw->setHazardReorder(c.reorder ? m_issueWindow : 0, m_latency);
+    hw->setPartitionCache(m_cache);
+    hw->setHWExtContext(m_hwExtContext);
+    hw->setHWLanes(m_hwLanes);
+    if(m_hwExtContext) hw->setOutstandingTxns(c.txns);
+  }
+
+  class SWRunner : public SpMVSemiring, public SWSpMV<SpMVInd, SpMVVal> {
+  public:
+    virtual unsigned int statInt(std::string name) {return 0;}
+    virtual std::vector<std::string> statKeys() {return std::vector<std::string>();}
+  };
+
+  class SWSymRunner : public SpMVSemiring, public SWSymSpMV<SpMVInd, SpMVVal> {
+  public:
+    virtual unsigned int statInt(std::string name) {return 0;}
+    virtual std::vector<std::string> statKeys() {return std::vector<std::string>();}
+  };
+
+  // candidate configurations, except for the txns (swept by runTrials)
+  std::vector<SpMVTuneConfig> candidates(CSC<SpMVInd, SpMVVal> * A, const MatrixFeatures & f) {
+    std::vector<SpMVTuneConfig> res;
+    SpMVTuneConfig c;
+    memset(&c, 0, sizeof(c));
+    c.useHW = 0;
+    res.push_back(c);
+    c.useHW = 1;
+    for(unsigned int pes = 1; pes <= m_maxPEs && pes <= f.rows; pes *= 2) {
+      c.numPEs = pes;
+      std::vector<PartitionScheme> schemes;
+      schemes.push_back(PARTITION_EQUAL_ROWS);
+      if(pes > 1 && equalRowsImbalance(A, pes) > AUTOTUNE_IMBALANCE)
+        schemes.push_back(PARTITION_NNZ_BALANCED);
+      std::vector<PartitionFormat> formats;
+      formats.push_back(PARTITION_FORMAT_CSC);
+      // most partition columns are empty if there are fewer nonzeros per
+      // partition than columns, try hypersparse partitions then
+      if(f.nz / pes < f.cols) formats.push_back(PARTITION_FORMAT_DCSC);
+      for(unsigned int s = 0; s < schemes.size(); s++) {
+        for(unsigned int fm = 0; fm < formats.size(); fm++) {
+          for(unsigned int r = 0; r <= (m_issueWindow != 0 ? 1 : 0); r++) {
+            c.scheme = schemes[s];
+            c.format = formats[fm];
+            c.reorder = r;
+            c.txns = 1;
+            res.push_back(c);
+          }
+        }
+      }
+    }
+    return res;
+  }
+
+  // largest partition nz / average partition nz for equal-row partitions
+  double equalRowsImbalance(CSC<SpMVInd, SpMVVal> * A, unsigned int numPartitions) {
+    std::vector<uint64_t> cnts = A->getPartitionElemCnts(numPartitions);
+    uint64_t maxCnt = 0;
+    for(unsigned int p = 0; p < cnts.size(); p++)
+      if(cnts[p] > maxCnt) maxCnt = cnts[p];
+    double avg = (double) A->getNNZ() / numPartitions;
+    return avg > 0 ? maxCnt / avg : 1;
+  }
+
+  // time the candidate on spmv, which is set up for it (for each txns
+  // setting on HW with external context memory, since these can be changed
+  // without setting up the matrix again), and update best and bestTime if
+  // it is faster. the time of a configuration is the fastest of m_trials
+  // runs after one warmup run, in microseconds.
+  void runTrials(CSC<SpMVInd, SpMVVal> * A, CSCSpMV<SpMVInd, SpMVVal> * spmv,
+                 SpMVTuneConfig c, SpMVTuneConfig & best, double & bestTime) {
+    std::vector<SpMVVal> x(A->getCols(), (SpMVVal) 1);
+    std::vector<SpMVVal> y(A->getRows(), (SpMVVal) 0);
+    bool sweepTxns = c.useHW && m_hwExtContext;
+    spmv->setA(A);
+    spmv->setx(&x[0]);
+    spmv->sety(&y[0]);
+    for(c.txns = 1; c.txns <= (sweepTxns ? 16 : 1); c.txns *= 2) {
+      if(sweepTxns) dynamic_cast<HWRunner *>(spmv)->setOutstandingTxns(c.txns);
+      spmv->exec();
+      double t = -1;
+      for(unsigned int i = 0; i < m_trials; i++) {
+        double start = timeUs();
+        spmv->exec();
+        double elapsed = timeUs() - start;
+        if(t < 0 || elapsed < t) t = elapsed;
+      }
+      std::cout << "Autotuner: " << describe(c) << " -> " << t << " us" << std::endl;
+      if(bestTime < 0 || t < bestTime) {
+        bestTime = t;
+        best = c;
+      }
+    }
+  }
+
+  static double timeUs() {
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec * 1000000.0 + tv.tv_usec;
+  }
+
+  // accelerator part of the database key: attach name, external context
+  // memory and frontend lanes
+  std::string hwKey() {
+    std::ostringstream ss;
+    ss << m_attachName << " " << (m_hwExtContext ? 1 : 0) << " " << m_hwLanes;
+    return ss.str();
+  }
+
+  // read the key of a database line, return the accelerator part
+  static std::string readKey(std::istringstream & ss, std::string & name, uint64_t & fp) {
+    std::string attach;
+    unsigned int ext = 0, lanes = 0;
+    ss >> name >> std::hex >> fp >> std::dec >> attach >> ext >> lanes;
+    std::ostringstream key;
+    key << attach << " " << ext << " " << lanes;
+    return key.str();
+  }
+
+  // database lines: name fingerprint attachName extContext lanes useHW
+  // numPEs scheme format reorder txns time(us)
+  bool lookup(std::string name, uint64_t fp, SpMVTuneConfig & c) {
+    std::ifstream db(m_dbFile.c_str());
+    std::string line;
+    while(std::getline(db, line)) {
+      std::istringstream ss(line);
+      std::string n;
+      uint64_t f = 0;
+      std::string hw = readKey(ss, n, f);
+      if(n != name || f != fp || hw != hwKey()) continue;
+      if(ss >> c.useHW >> c.numPEs >> c.scheme >> c.format >> c.reorder >> c.txns) {
+        if(!c.useHW || c.numPEs <= m_maxPEs) return true;
+      }
+    }
+    return false;
+  }
+
+  // replace the entry of this matrix and accelerator in the database.
+  // failures are reported but not fatal.
+  void store(std::string name, uint64_t fp, SpMVTuneConfig c, double timeUs) {
+    std::vector<std::string> lines;
+    std::ifstream in(m_dbFile.c_str());
+    std::string line;
+    while(std::getline(in, line)) {
+      std::istringstream ss(line);
+      std::string n;
+      uint64_t f = 0;
+      std::string hw = readKey(ss, n, f);
+      if((n != name || hw != hwKey()) && !line.empty()) lines.push_back(line);
+    }
+    in.close();
+    std::ostringstream entry;
+    entry << name << " " << std::hex << fp << std::dec << " " << hwKey() << " ";
+    entry << c.useHW << " ";
+    entry << c.numPEs << " " << c.scheme << " " << c.format << " " << c.reorder;
+    entry << " " << c.txns << " " << timeUs;
+    lines.push_back(entry.str());
+    std::ofstream out(m_dbFile.c_str());
+    for(unsigned int i = 0; i < lines.size(); i++) out << lines[i] << std::endl;
+    if(!out) std::cerr << "Could not write autotuner database " << m_dbFile << std::endl;
+  }
+};
+
+#endif // AUTOTUNER_HPP
@@ -1,6 +1,7 @@
 #ifndef COMMONSEMIRINGS_HPP
 #define COMMONSEMIRINGS_HPP
 
+#include <limits>
 #include "semiring.hpp"
 
 template <class SpMVInd, class SpMVVal>
@@ -17,14 +18,42 @@ protected:
 
 template <class SpMVInd, class SpMVVal>
 class MinPlusSemiring: public virtual Semiring<SpMVInd, SpMVVal> {
+public:
+  virtual SpMVVal zero() {return std::numeric_limits<SpMVVal>::max();}
+  virtual SpMVVal one() {return (SpMVVal) 0;}
+  virtual SemiringAddOp hwAddOp() {return SEMIRING_ADD_MIN;}
+  virtual SemiringMulOp hwMulOp() {return SEMIRING_MUL_PLUS;}
+
 protected:
   virtual SpMVVal add(SpMVVal first, SpMVVal second, SpMVInd row, SpMVInd col) {
     return (first < second ? first : second);
   }
 
+  // saturates at zero() (unreachable), like SemiringOps.satPlus in HW
   virtual SpMVVal mul(SpMVVal first, SpMVVal second, SpMVInd row, SpMVInd col) {
+    SpMVVal inf = zero();
+    if(first == inf || second == inf) return inf;
+    if(second > 0 && first > inf - second) return inf;
     return first + second;
   }
 };
 
+// boolean semiring for reachability (e.g. BFS frontier expansion), any
+// nonzero value is treated as true. usually used with pattern-only matrices.
+template <class SpMVInd, class SpMVVal>
+class BoolOrAndSemiring: public virtual Semiring<SpMVInd, SpMVVal> {
+public:
+  virtual SemiringAddOp hwAddOp() {return SEMIRING_ADD_OR;}
+  virtual SemiringMulOp hwMulOp() {return SEMIRING_MUL_AND;}
+
+protected:
+  virtual SpMVVal add(SpMVVal first, SpMVVal second, SpMVInd row, SpMVInd col) {
+    return (first != 0 || second != 0) ? 1 : 0;
+  }
+
+  virtual SpMVVal mul(SpMVVal first, SpMVVal second, SpMVInd row, SpMVInd col) {
+    return (first != 0 && second != 0) ? 1 : 0;
+  }
+};
+
 #endif // COMMONSEMIRINGS_HPP
@@ -1,12 +1,50 @@
 #ifndef CSC_H_
-#define CSC_H
+#define CSC_H_
 
+#include <stdint.h>
 #include <string.h>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <iostream>
+#include "hostarena.hpp"
+
+// read a matrix component file into a newly allocated buffer. if numBytes
+// is given, the size of the component is returned through it.
+extern void * readMatrixData(std::string name, std::string component, uint64_t * numBytes = 0);
+
+// flags in SparseMatrixMetadata
+// symmetric matrix, only the lower triangle and the diagonal (row >= col)
+// are stored and nz counts the stored nonzeros
+#define SPARSEMATRIX_SYMMETRIC  1
+
+// row and column counts are 32-bit, but nz (and everything derived from it,
+// like byte counts) is 64-bit so that matrices with more than 4G nonzeros
+// or more than 4 GB per component can be handled on the host side.
+typedef struct {
+  unsigned int rows;
+  unsigned int cols;
+  uint64_t nz;
+  unsigned int startingRow;
+  unsigned int startingCol;
+  unsigned int bytesPerInd;
+  unsigned int bytesPerVal;
+  unsigned int flags;
+  unsigned int reserved;
+} SparseMatrixMetadata;
 
-extern void * readMatrixData(std::string name, std::string component);
+// metadata layout before flags were added
+typedef struct {
+  unsigned int rows;
+  unsigned int cols;
+  uint64_t nz;
+  unsigned int startingRow;
+  unsigned int startingCol;
+  unsigned int bytesPerInd;
+  unsigned int bytesPerVal;
+} SparseMatrixMetadataV2;
 
+// metadata layout before nz was widened to 64 bits
 typedef struct {
   unsigned int rows;
   unsigned int cols;
@@ -15,7 +53,7 @@ typedef struct {
   unsigned int startingCol;
   unsigned int bytesPerInd;
   unsigned int bytesPerVal;
-} SparseMatrixMetadata;
+} SparseMatrixMetadataV1;
 
 
 template <class SpMVInd, class SpMVVal>
@@ -25,15 +63,18 @@ public:
   CSC() {
     m_metadata = 0;
     m_indPtrs = 0; m_inds = 0; m_nzData = 0;
+    m_ownsData = true;
     m_name = "<not initialized>";
   }
 
   virtual ~CSC(){
     if(m_metadata) {
       delete m_metadata;
-      delete [] m_indPtrs;
-      delete [] m_inds;
-      delete [] m_nzData;
+      if(m_ownsData) {
+        delete [] m_indPtrs;
+        delete [] m_inds;
+        delete [] m_nzData;
+      }
     }
   }
 
@@ -52,24 +93,128 @@ public:
   void setName(std::string name) {m_name = name;}
   std::string getName() {return m_name;}
 
+  // matrices with bytesPerVal = 0 are pattern-only: there is no nzdata,
+  // and the value of every nonzero is the semiring one
   static CSC * load(std::string name) {
-    SparseMatrixMetadata * md = (SparseMatrixMetadata *)readMatrixData(name, "meta");
+    SparseMatrixMetadata * md = loadMetadata(name);
+    if(md->bytesPerVal != 0 && md->bytesPerVal != sizeof(SpMVVal)) {
+        throw "bytesPerVal mismatch in CSC::load, use loadConverted";
+    }
+    CSC * ret = loadStructure(name, md);
+    if(md->bytesPerVal != 0)
+      ret->m_nzData = (SpMVVal *) loadValues(name, md);
+
+    return ret;
+  }
+
+  // load a matrix whose values are stored as DiskVal, converting them to
+  // SpMVVal (e.g. int64 -> int32 or float). if scale is given, values are
+  // multiplied by it before the (truncating) conversion, which can be used
+  // to quantize floating point values into small integers.
+  template <class DiskVal>
+  static CSC * loadConverted(std::string name, double scale = 1.0) {
+    SparseMatrixMetadata * md = loadMetadata(name);
+    if(md->bytesPerVal != sizeof(DiskVal)) {
+        throw "bytesPerVal mismatch in CSC::loadConverted";
+    }
+    CSC * ret = loadStructure(name, md);
+    DiskVal * diskData = (DiskVal *) loadValues(name, md);
+    ret->m_nzData = new SpMVVal[md->nz];
+    uint64_t inexact = 0;
+    for(uint64_t i = 0; i < md->nz; i++) {
+      if(scale == 1.0) {
+        ret->m_nzData[i] = (SpMVVal) diskData[i];
+        if((DiskVal) ret->m_nzData[i] != diskData[i]) inexact++;
+      } else
+        ret->m_nzData[i] = (SpMVVal) (diskData[i] * scale);
+    }
+    delete [] (char *) diskData;
+    md->bytesPerVal = sizeof(SpMVVal);
+    if(inexact != 0)
+      std::cerr << "Warning: " << inexact << " values changed in conversion for " << name << std::endl;
+
+    return ret;
+  }
+
+  // load the matrix metadata, converting from the old 32-bit nz or
+  // no-flags layouts if needed (recognized by their size)
+  static SparseMatrixMetadata * loadMetadata(std::string name) {
+    uint64_t numBytes = 0;
+    char * buf = (char *) readMatrixData(name, "meta", &numBytes);
+    SparseMatrixMetadata * md = new SparseMatrixMetadata;
+    md->flags = 0;
+    md->reserved = 0;
+    if(numBytes == sizeof(SparseMatrixMetadata)) {
+      memcpy(md, buf, sizeof(SparseMatrixMetadata));
+      delete [] buf;
+      return md;
+    }
+    if(numBytes == sizeof(SparseMatrixMetadataV2)) {
+      memcpy(md, buf, sizeof(SparseMatrixMetadataV2));
+      delete [] buf;
+      return md;
+    }
+    if(numBytes != sizeof(SparseMatrixMetadataV1)) {
+      delete md;
+      delete [] buf;
+      throw "unknown metadata size in CSC::loadMetadata";
+    }
+    SparseMatrixMetadataV1 * old = (SparseMatrixMetadataV1 *) buf;
+    md->rows = old->rows;
+    md->cols = old->cols;
+    md->nz = old->nz;
+    md->startingRow = old->startingRow;
+    md->startingCol = old->startingCol;
+    md->bytesPerInd = old->bytesPerInd;
+    md->bytesPerVal = old->bytesPerVal;
+    delete [] buf;
+    return md;
+  }
+
+  // load indptr and inds into a new matrix, checking their sizes
+  static CSC * loadStructure(std::string name, SparseMatrixMetadata * md) {
     if(md->bytesPerInd != sizeof(SpMVInd)) {
         throw "bytesPerInd mismatch in CSC::load";
     }
-    if(md->bytesPerVal != sizeof(SpMVVal)) {
-        throw "bytesPerVal mismatch in CSC::load";
+    // the index pointers must be able to address all nonzeros
+    if((uint64_t)(SpMVInd) md->nz != md->nz) {
+        throw "nz exceeds the range of SpMVInd in CSC::load";
     }
     CSC * ret = new CSC();
+    uint64_t numBytes = 0;
     ret->m_metadata = md;
-    ret->m_indPtrs = (SpMVInd *)readMatrixData(name, "indptr");
+    ret->m_indPtrs = (SpMVInd *)readMatrixData(name, "indptr", &numBytes);
     if(!ret->m_indPtrs) throw "could not load indptr in CSC::load";
-    ret->m_inds = (SpMVInd *)readMatrixData(name, "inds");
+    if(numBytes != sizeof(SpMVInd) * ((uint64_t) md->cols + 1)) throw "indptr size mismatch in CSC::load";
+    ret->m_inds = (SpMVInd *)readMatrixData(name, "inds", &numBytes);
     if(!ret->m_inds) throw "could not load inds in CSC::load";
-    ret->m_nzData = (SpMVVal *)readMatrixData(name, "nzdata");
-    if(!ret->m_nzData) throw "could not load nzdata in CSC::load";
+    if(numBytes != sizeof(SpMVInd) * md->nz) throw "inds size mismatch in CSC::load";
     ret->m_name = name;
+    return ret;
+  }
 
+  // load nzdata as stored on disk (md->bytesPerVal bytes per value)
+  static void * loadValues(std::string name, SparseMatrixMetadata * md) {
+    uint64_t numBytes = 0;
+    void * data = readMatrixData(name, "nzdata", &numBytes);
+    if(!data) throw "could not load nzdata in CSC::load";
+    if(numBytes != md->bytesPerVal * md->nz) throw "nzdata size mismatch in CSC::load";
+    return data;
+  }
+
+  // wrap existing arrays into a CSC matrix. the metadata is always taken
+  // over, the arrays only if ownsData is true (otherwise they must outlive
+  // the matrix, e.g. when they come from a HostArena)
+  static CSC * fromArrays(SparseMatrixMetadata * md, SpMVInd * indPtrs,
+                          SpMVInd * inds, SpMVVal * nzData, bool ownsData,
+                          std::string name) {
+    CSC * ret = new CSC();
+    ret->m_metadata = md;
+    ret->m_indPtrs = indPtrs;
+    ret->m_inds = inds;
+    ret->m_nzData = nzData;
+    ret->m_ownsData = ownsData;
+    ret->m_name = name;
     return ret;
   }
 
@@ -81,6 +226,9 @@ public:
     ret->m_metadata->cols = dim;
     ret->m_metadata->rows = dim;
     ret->m_metadata->nz = dim;
+    ret->m_metadata->bytesPerInd = sizeof(SpMVInd);
+    ret->m_metadata->bytesPerVal = sizeof(SpMVVal);
+    ret->m_metadata->flags = 0;
     ret->m_indPtrs = new SpMVInd[dim+1];
     ret->m_inds = new SpMVInd[dim];
     ret->m_nzData = new SpMVVal[dim];
@@ -97,22 +245,28 @@ public:
   }
 
   static CSC * dense(unsigned int dim) {
+    uint64_t nz = (uint64_t) dim * dim;
+    if((uint64_t)(SpMVInd) nz != nz)
+      throw "nz exceeds the range of SpMVInd in CSC::dense";
     CSC * ret = new CSC();
     ret->m_metadata = new SparseMatrixMetadata;
     ret->m_metadata->startingRow = 0;
     ret->m_metadata->startingCol = 0;
     ret->m_metadata->cols = dim;
     ret->m_metadata->rows = dim;
-    ret->m_metadata->nz = dim*dim;
+    ret->m_metadata->nz = nz;
+    ret->m_metadata->bytesPerInd = sizeof(SpMVInd);
+    ret->m_metadata->bytesPerVal = sizeof(SpMVVal);
+    ret->m_metadata->flags = 0;
     ret->m_indPtrs = new SpMVInd[dim+1];
-    ret->m_inds = new SpMVInd[dim*dim];
-    ret->m_nzData = new SpMVVal[dim*dim];
+    ret->m_inds = new SpMVInd[nz];
+    ret->m_nzData = new SpMVVal[nz];
 
     for(SpMVInd i = 0; i < dim; i++)
-      ret->m_indPtrs[i] = i*dim;
-    ret->m_indPtrs[dim] = dim*dim;
+      ret->m_indPtrs[i] = (uint64_t) i*dim;
+    ret->m_indPtrs[dim] = nz;
 
-    for(SpMVInd i = 0; i < dim*dim; i++) {
+    for(uint64_t i = 0; i < nz; i++) {
         ret->m_inds[i] = i % dim;
         ret->m_nzData[i] = i+1;
     }
@@ -122,6 +276,36 @@ public:
     return ret;
   }
 
+  // dim x dim matrix with one nonzero per column, where runs of runLength
+  // consecutive columns all hit the same row (column c has its nonzero in
+  // row c / runLength). the nonzero stream then has long same-row runs.
+  static CSC * rowRuns(unsigned int dim, unsigned int runLength) {
+    if(runLength == 0) throw "runLength must be nonzero in CSC::rowRuns";
+    CSC * ret = new CSC();
+    ret->m_metadata = new SparseMatrixMetadata;
+    ret->m_metadata->startingRow = 0;
+    ret->m_metadata->startingCol = 0;
+    ret->m_metadata->cols = dim;
+    ret->m_metadata->rows = dim;
+    ret->m_metadata->nz = dim;
+    ret->m_metadata->bytesPerInd = sizeof(SpMVInd);
+    ret->m_metadata->bytesPerVal = sizeof(SpMVVal);
+    ret->m_metadata->flags = 0;
+    ret->m_indPtrs = new SpMVInd[dim+1];
+    ret->m_inds = new SpMVInd[dim];
+    ret->m_nzData = new SpMVVal[dim];
+
+    for(SpMVInd i = 0; i < dim; i++) {
+        ret->m_indPtrs[i] = i;
+        ret->m_inds[i] = i / runLength;
+        ret->m_nzData[i] = i+1;
+    }
+    ret->m_indPtrs[dim] = dim;
+    ret->setName("rowruns");
+
+    return ret;
+  }
+
   unsigned int getCols() const {
     return m_metadata->cols;
   }
@@ -134,7 +318,7 @@ public:
     return m_inds;
   }
 
-  unsigned int getNNZ() const {
+  uint64_t getNNZ() const {
     return m_metadata->nz;
   }
 
@@ -142,10 +326,105 @@ public:
     return m_nzData;
   }
 
+  // true if the matrix has no values, every nonzero is the semiring one.
+  // decided by the metadata, since empty matrices may have no nzdata either
+  bool isPatternOnly() const {
+    return m_metadata->bytesPerVal == 0;
+  }
+
+  // throw away the values and keep only the sparsity pattern, e.g. for
+  // running BFS on a weighted graph
+  void dropValues() {
+    if(m_ownsData) delete [] m_nzData;
+    m_nzData = 0;
+    m_metadata->bytesPerVal = 0;
+  }
+
   unsigned int getRows() const {
     return m_metadata->rows;
   }
 
+  // true if only one triangle of a symmetric matrix is stored
+  bool isSymmetric() const {
+    return (m_metadata->flags & SPARSEMATRIX_SYMMETRIC) != 0;
+  }
+
+  // create a symmetric-storage copy of this matrix, keeping the lower
+  // triangle and the diagonal. the matrix is assumed to be symmetric, the
+  // upper triangle is not checked.
+  CSC * lowerTriangle() {
+    if(!isSquare()) throw "Symmetric storage needs a square matrix";
+    std::vector<SpMVInd> inds;
+    std::vector<SpMVVal> nzData;
+    SpMVInd * indPtrs = new SpMVInd[m_metadata->cols + 1];
+    for(SpMVInd col = 0; col < m_metadata->cols; col++) {
+      indPtrs[col] = inds.size();
+      for(SpMVInd ep = m_indPtrs[col]; ep < m_indPtrs[col+1]; ep++) {
+        if(m_inds[ep] < col) continue;
+        inds.push_back(m_inds[ep]);
+        if(!isPatternOnly()) nzData.push_back(m_nzData[ep]);
+      }
+    }
+    indPtrs[m_metadata->cols] = inds.size();
+    SparseMatrixMetadata * md = new SparseMatrixMetadata;
+    *md = *m_metadata;
+    md->nz = inds.size();
+    md->flags |= SPARSEMATRIX_SYMMETRIC;
+    SpMVInd * newInds = new SpMVInd[md->nz];
+    std::copy(inds.begin(), inds.end(), newInds);
+    SpMVVal * newData = 0;
+    if(!isPatternOnly()) {
+      newData = new SpMVVal[md->nz];
+      std::copy(nzData.begin(), nzData.end(), newData);
+    }
+    return fromArrays(md, indPtrs, newInds, newData, true, m_name);
+  }
+
+  // create the full matrix from a symmetric one, by adding the transpose of
+  // the off-diagonal nonzeros. arrays come from the arena if one is given.
+  // the row indices stay sorted within each column if they were sorted.
+  CSC * expandSymmetric(HostArena * arena = 0) {
+    if(!isSymmetric()) throw "expandSymmetric needs a symmetric matrix";
+    unsigned int cols = m_metadata->cols;
+    // count the nonzeros of each full column
+    std::vector<uint64_t> colStart(cols + 1, 0);
+    uint64_t nz = 0;
+    for(SpMVInd col = 0; col < cols; col++) {
+      for(SpMVInd ep = m_indPtrs[col]; ep < m_indPtrs[col+1]; ep++) {
+        colStart[col+1]++;
+        if(m_inds[ep] != col) colStart[m_inds[ep]+1]++;
+      }
+    }
+    for(unsigned int c = 0; c < cols; c++) colStart[c+1] += colStart[c];
+    nz = colStart[cols];
+    if((uint64_t)(SpMVInd) nz != nz)
+      throw "nz exceeds the range of SpMVInd in CSC::expandSymmetric";
+    SparseMatrixMetadata * md = new SparseMatrixMetadata;
+    *md = *m_metadata;
+    md->nz = nz;
+    md->flags &= ~SPARSEMATRIX_SYMMETRIC;
+    SpMVInd * indPtrs = HostArena::newArray<SpMVInd>(arena, cols + 1);
+    SpMVInd * inds = HostArena::newArray<SpMVInd>(arena, nz);
+    SpMVVal * nzData = isPatternOnly() ? 0 : HostArena::newArray<SpMVVal>(arena, nz);
+    for(unsigned int c = 0; c <= cols; c++) indPtrs[c] = colStart[c];
+    // the upper triangle entries of column c come from columns < c, so they
+    // are all placed before the stored (row >= c) entries of column c
+    for(SpMVInd col = 0; col < cols; col++) {
+      for(SpMVInd ep = m_indPtrs[col]; ep < m_indPtrs[col+1]; ep++) {
+        SpMVInd row = m_inds[ep];
+        uint64_t pos = colStart[col]++;
+        inds[pos] = row;
+        if(nzData) nzData[pos] = m_nzData[ep];
+        if(row != col) {
+          pos = colStart[row]++;
+          inds[pos] = col;
+          if(nzData) nzData[pos] = m_nzData[ep];
+        }
+      }
+    }
+    return fromArrays(md, indPtrs, inds, nzData, arena == 0, m_name);
+  }
+
   unsigned int getStartingRow() const {
     return m_metadata->startingRow;
   }
@@ -154,13 +433,13 @@ public:
   // number of elements in each partition. e.g boundaries = {0 10 20}
   // partition 0 will contain elements with i s.t. 0 <= i < 10
   // partition 1 will contain elements with i s.t. 10 <= i < 20
-  std::vector<unsigned int> getPartitionElemCnts(std::vector<SpMVInd> boundaries) {
+  std::vector<uint64_t> getPartitionElemCnts(std::vector<SpMVInd> boundaries) {
     unsigned int numPartitions = boundaries.size() - 1;
-    std::vector<unsigned int> res;
+    std::vector<uint64_t> res;
     // initialize all partition counts to zero
     for(unsigned int i=0; i<numPartitions; i++) res.push_back(0);
     // iterate over row indices to determine real counts for each partition
-    for(unsigned int i=0; i < m_metadata->nz; i++) {
+    for(uint64_t i=0; i < m_metadata->nz; i++) {
       SpMVInd currentInd = m_inds[i];
       for(unsigned int p=0; p<numPartitions; p++) {
         if((boundaries[p] <= currentInd) && (currentInd < boundaries[p+1])) {
@@ -174,30 +453,60 @@ public:
 
   // returns a vector with the number of elements per partition, using equidistant
   // partition boundaries (e.g. with the matrix split into equal-sized chunks)
-  std::vector<unsigned int> getPartitionElemCnts(unsigned int numPartitions) {
+  std::vector<uint64_t> getPartitionElemCnts(unsigned int numPartitions) {
     return getPartitionElemCnts(calcDivBoundaries(numPartitions));
   }
 
+  // the rows are split as evenly as possible, partition sizes differ by at
+  // most one row and no partition is empty if there are enough rows
   std::vector<SpMVInd> calcDivBoundaries(unsigned int numPartitions) {
     std::vector<SpMVInd> boundaries;
-    unsigned int divSize = (m_metadata->rows + numPartitions) / numPartitions;
     for(unsigned int i = 0; i < numPartitions; i++) {
-      boundaries.push_back(divSize * i);
+      boundaries.push_back((SpMVInd) (((uint64_t) m_metadata->rows * i) / numPartitions));
     }
-    // push the matrix nz count as the upper bound
+    // push the matrix row count as the upper bound
     boundaries.push_back(m_metadata->rows);
     return boundaries;
   }
 
+  // partition boundaries that give each partition about the same number of
+  // nonzeros instead of rows, for matrices with uneven rows. every
+  // partition gets at least one row if there are enough rows.
+  std::vector<SpMVInd> calcNNZBoundaries(unsigned int numPartitions) {
+    unsigned int rows = m_metadata->rows;
+    std::vector<uint64_t> rowCnt(rows, 0);
+    for(uint64_t i = 0; i < m_metadata->nz; i++) rowCnt[m_inds[i]]++;
+    std::vector<SpMVInd> boundaries;
+    boundaries.push_back(0);
+    uint64_t acc = 0;
+    unsigned int row = 0;
+    for(unsigned int p = 1; p < numPartitions; p++) {
+      uint64_t target = (m_metadata->nz * p) / numPartitions;
+      // leave at least one row for each of the remaining partitions
+      unsigned int maxRow = rows > numPartitions - p ? rows - (numPartitions - p) : 0;
+      while(row < maxRow && (acc < target || row == boundaries.back())) {
+        acc += rowCnt[row];
+        row++;
+      }
+      boundaries.push_back(row);
+    }
+    boundaries.push_back(rows);
+    return boundaries;
+  }
+
 
   //partition the CSC matrix into <numPartitions> chunks (sliced along rows)
-  std::vector<CSC<SpMVInd, SpMVVal> * > partition(unsigned int numPartitions) {
-    return partition(calcDivBoundaries(numPartitions));
+  // if an arena is given, the partition arrays are allocated from it and
+  // are freed together when the arena is released, not by ~CSC
+  std::vector<CSC<SpMVInd, SpMVVal> * > partition(unsigned int numPartitions,
+                                                  HostArena * arena = 0) {
+    return partition(calcDivBoundaries(numPartitions), arena);
   }
 
 
-  std::vector<CSC<SpMVInd, SpMVVal> * > partition(std::vector<SpMVInd> boundaries) {
-    std::vector<unsigned int> cnts = getPartitionElemCnts(boundaries);
+  std::vector<CSC<SpMVInd, SpMVVal> * > partition(std::vector<SpMVInd> boundaries,
+                                                  HostArena * arena = 0) {
+    std::vector<uint64_t> cnts = getPartitionElemCnts(boundaries);
     unsigned int numPartitions = boundaries.size() - 1;
     std::vector<CSC<SpMVInd, SpMVVal> * > res;
     for(unsigned int i = 0; i < numPartitions; i++) {
@@ -210,9 +519,13 @@ public:
         res[i]->m_metadata->startingCol = 0;
         res[i]->m_metadata->bytesPerInd = m_metadata->bytesPerInd;
         res[i]->m_metadata->bytesPerVal = m_metadata->bytesPerVal;
-        res[i]->m_indPtrs = new SpMVInd[m_metadata->cols+1];
-        res[i]->m_inds = new SpMVInd[cnts[i]];
-        res[i]->m_nzData = new SpMVVal[cnts[i]];
+        res[i]->m_metadata->flags = 0;
+        res[i]->m_ownsData = (arena == 0);
+        res[i]->m_indPtrs = HostArena::newArray<SpMVInd>(arena, m_metadata->cols+1);
+        res[i]->m_inds = HostArena::newArray<SpMVInd>(arena, cnts[i]);
+        res[i]->m_nzData = 0;
+        if(!isPatternOnly())
+          res[i]->m_nzData = HostArena::newArray<SpMVVal>(arena, cnts[i]);
         char partName[256];
         itoa(i, partName);
         res[i]->m_name = m_name + "-p" + std::string(partName);
@@ -237,7 +550,7 @@ public:
               // copy data into partition
               // elem index is "rebased" on the partition lower bound
               res[p]->m_inds[partitionElemPos] = currentInd - lowerB;
-              res[p]->m_nzData[partitionElemPos] = m_nzData[elm];
+              if(res[p]->m_nzData) res[p]->m_nzData[partitionElemPos] = m_nzData[elm];
               // increment the end of column pointer
               res[p]->m_indPtrs[col + 1] =  partitionElemPos + 1;
               // each element goes to one partition only, break
@@ -269,6 +582,8 @@ protected:
   SpMVInd * m_indPtrs;
   SpMVInd * m_inds;
   SpMVVal * m_nzData;
+  // false if the arrays belong to someone else (e.g. a HostArena)
+  bool m_ownsData;
   std::string m_name;
 
   /* itoa:  convert n to characters in s */
@@ -0,0 +1,145 @@
+#ifndef CSCDELTA_HPP
+#define CSCDELTA_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include "csc.hpp"
+
+// pending nonzero updates (insertions and removals) for a CSC matrix, to be
+// merged into it later. used to keep dynamic graphs up to date without
+// rebuilding and re-uploading the whole matrix for every change.
+// an insertion adds a nonzero even if the coordinate already has one (both
+// are then combined by the semiring add), a removal drops all nonzeros at
+// the coordinate, including earlier pending insertions.
+// the pending insertions are a small sparse matrix on their own, so their
+// contribution to y can be computed separately until the next merge.
+// removals can not (the semiring add need not have an inverse), the matrix
+// must be merged before it is used again.
+
+template <class SpMVInd, class SpMVVal>
+class CSCDelta {
+public:
+  typedef struct {
+    SpMVInd row;
+    SpMVInd col;
+    SpMVVal val;
+  } DeltaEntry;
+
+  CSCDelta() {}
+  virtual ~CSCDelta() {}
+
+  void insert(SpMVInd row, SpMVInd col, SpMVVal val) {
+    DeltaEntry e;
+    e.row = row;
+    e.col = col;
+    e.val = val;
+    m_insertions.push_back(e);
+  }
+
+  void remove(SpMVInd row, SpMVInd col) {
+    // cancel any pending insertions at the same coordinate
+    unsigned int kept = 0;
+    for(unsigned int i = 0; i < m_insertions.size(); i++) {
+      if(m_insertions[i].row != row || m_insertions[i].col != col)
+        m_insertions[kept++] = m_insertions[i];
+    }
+    m_insertions.resize(kept);
+    DeltaEntry e;
+    e.row = row;
+    e.col = col;
+    e.val = 0;
+    m_removals.push_back(e);
+  }
+
+  const std::vector<DeltaEntry> & getInsertions() const {
+    return m_insertions;
+  }
+
+  bool hasRemovals() const {
+    return !m_removals.empty();
+  }
+
+  uint64_t size() const {
+    return m_insertions.size() + m_removals.size();
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  void clear() {
+    m_insertions.clear();
+    m_removals.clear();
+  }
+
+  // create a new matrix with the pending updates applied to A. the new
+  // matrix owns its arrays and keeps the metadata (e.g. startingRow) of A.
+  // nonzeros stay in their original order within each column, inserted
+  // ones are added at the column ends. the delta is not cleared.
+  CSC<SpMVInd, SpMVVal> * merge(CSC<SpMVInd, SpMVVal> * A) {
+    std::vector<DeltaEntry> ins(m_insertions);
+    std::vector<DeltaEntry> rem(m_removals);
+    std::stable_sort(ins.begin(), ins.end(), compareColRow);
+    std::sort(rem.begin(), rem.end(), compareColRow);
+    unsigned int cols = A->getCols();
+    SpMVInd * indPtrs = A->getIndPtrs();
+    SpMVInd * inds = A->getInds();
+    SpMVVal * nzData = A->getNZData();
+    bool patternOnly = A->isPatternOnly();
+
+    std::vector<SpMVInd> newInds;
+    std::vector<SpMVVal> newData;
+    SpMVInd * newIndPtrs = new SpMVInd[cols + 1];
+    unsigned int insPos = 0;
+    for(SpMVInd col = 0; col < cols; col++) {
+      newIndPtrs[col] = newInds.size();
+      for(SpMVInd ep = indPtrs[col]; ep < indPtrs[col+1]; ep++) {
+        DeltaEntry e;
+        e.row = inds[ep];
+        e.col = col;
+        if(!rem.empty() && std::binary_search(rem.begin(), rem.end(), e, compareColRow))
+          continue;
+        newInds.push_back(inds[ep]);
+        if(!patternOnly) newData.push_back(nzData[ep]);
+      }
+      for(; insPos < ins.size() && ins[insPos].col == col; insPos++) {
+        newInds.push_back(ins[insPos].row);
+        if(!patternOnly) newData.push_back(ins[insPos].val);
+      }
+    }
+    newIndPtrs[cols] = newInds.size();
+    if((uint64_t)(SpMVInd) newInds.size() != newInds.size())
+      throw "nz exceeds the range of SpMVInd in CSCDelta::merge";
+
+    SparseMatrixMetadata * md = new SparseMatrixMetadata;
+    md->rows = A->getRows();
+    md->cols = cols;
+    md->nz = newInds.size();
+    md->startingRow = A->getStartingRow();
+    md->startingCol = 0;
+    md->bytesPerInd = sizeof(SpMVInd);
+    md->bytesPerVal = patternOnly ? 0 : sizeof(SpMVVal);
+    md->flags = 0;
+    SpMVInd * mergedInds = new SpMVInd[md->nz];
+    std::copy(newInds.begin(), newInds.end(), mergedInds);
+    SpMVVal * mergedData = 0;
+    if(!patternOnly) {
+      mergedData = new SpMVVal[md->nz];
+      std::copy(newData.begin(), newData.end(), mergedData);
+    }
+    return CSC<SpMVInd, SpMVVal>::fromArrays(md, newIndPtrs, mergedInds,
+                                             mergedData, true, A->getName());
+  }
+
+protected:
+  std::vector<DeltaEntry> m_insertions;
+  std::vector<DeltaEntry> m_removals;
+
+  static bool compareColRow(const DeltaEntry & a, const DeltaEntry & b) {
+    if(a.col != b.col) return a.col < b.col;
+    return a.row < b.row;
+  }
+};
+
+#endif // CSCDELTA_HPP
@@ -0,0 +1,168 @@
+#ifndef DCSC_HPP
+#define DCSC_HPP
+
+#include <vector>
+#include <algorithm>
+#include "csc.hpp"
+
+// doubly-compressed sparse column (DCSC) matrix, for hypersparse partitions
+// where most columns are empty. only the non-empty columns are stored:
+// the CSC part of the object describes the compressed matrix (so getCols()
+// returns the number of non-empty columns and getIndPtrs() has one entry
+// per non-empty column + 1), and getColInds() maps each compressed column
+// back to its column index in the original matrix.
+// since the CSC part is a valid CSC matrix on its own, it can be handed to
+// the HW SpMV as-is, as long as the input vector is gathered to match
+// the compressed columns (see gatherInput).
+
+template <class SpMVInd, class SpMVVal>
+class DCSC : public CSC<SpMVInd, SpMVVal> {
+public:
+  DCSC() {
+    m_colInds = 0;
+    m_fullCols = 0;
+    this->m_name = "<not initialized>";
+  }
+
+  virtual ~DCSC() {
+    if(this->m_ownsData) delete [] m_colInds;
+  }
+
+  // number of columns in the original (uncompressed) matrix
+  unsigned int getFullCols() const {
+    return m_fullCols;
+  }
+
+  // number of non-empty columns
+  unsigned int getNZCols() const {
+    return this->getCols();
+  }
+
+  // original column index for each non-empty column
+  SpMVInd* getColInds() const {
+    return m_colInds;
+  }
+
+  // gather the input vector elements for the non-empty columns,
+  // xc must have room for getNZCols() elements
+  void gatherInput(const SpMVVal * x, SpMVVal * xc) const {
+    for(unsigned int c = 0; c < getNZCols(); c++)
+      xc[c] = x[m_colInds[c]];
+  }
+
+  // wrap existing arrays into a DCSC matrix, like CSC::fromArrays.
+  // md->cols must be the number of non-empty columns.
+  static DCSC * fromArrays(SparseMatrixMetadata * md, unsigned int fullCols,
+                           SpMVInd * indPtrs, SpMVInd * colInds, SpMVInd * inds,
+                           SpMVVal * nzData, bool ownsData, std::string name) {
+    DCSC * ret = new DCSC();
+    ret->m_metadata = md;
+    ret->m_fullCols = fullCols;
+    ret->m_indPtrs = indPtrs;
+    ret->m_colInds = colInds;
+    ret->m_inds = inds;
+    ret->m_nzData = nzData;
+    ret->m_ownsData = ownsData;
+    ret->m_name = name;
+    return ret;
+  }
+
+  // partition the CSC matrix into <numPartitions> DCSC chunks (sliced along
+  // rows), using the same boundaries as CSC::partition
+  static std::vector<DCSC<SpMVInd, SpMVVal> * > partition(CSC<SpMVInd, SpMVVal> * A,
+                                                          unsigned int numPartitions,
+                                                          HostArena * arena = 0) {
+    return partition(A, A->calcDivBoundaries(numPartitions), arena);
+  }
+
+  // unlike CSC::partition, memory and time here scale with the nz count
+  // instead of with numPartitions * cols. arrays come from the arena if one
+  // is given, like in CSC::partition
+  static std::vector<DCSC<SpMVInd, SpMVVal> * > partition(CSC<SpMVInd, SpMVVal> * A,
+                                                          std::vector<SpMVInd> boundaries,
+                                                          HostArena * arena = 0) {
+    unsigned int numPartitions = boundaries.size() - 1;
+    unsigned int cols = A->getCols();
+    SpMVInd * indPtrs = A->getIndPtrs();
+    SpMVInd * inds = A->getInds();
+    SpMVVal * nzData = A->getNZData();
+    std::vector<uint64_t> nzCnt(numPartitions, 0);
+    std::vector<unsigned int> colCnt(numPartitions, 0);
+    // last column seen by each partition, cols means none yet
+    std::vector<SpMVInd> lastCol(numPartitions, cols);
+
+    // first pass: count the nonzeros and non-empty columns per partition
+    for(SpMVInd col = 0; col < cols; col++) {
+      for(SpMVInd elm = indPtrs[col]; elm < indPtrs[col+1]; elm++) {
+        unsigned int p = findPartition(boundaries, inds[elm]);
+        nzCnt[p]++;
+        if(lastCol[p] != col) {
+          colCnt[p]++;
+          lastCol[p] = col;
+        }
+      }
+    }
+
+    std::vector<DCSC<SpMVInd, SpMVVal> * > res;
+    for(unsigned int i = 0; i < numPartitions; i++) {
+        DCSC<SpMVInd, SpMVVal> * part = new DCSC<SpMVInd, SpMVVal>();
+        part->m_metadata = new SparseMatrixMetadata;
+        part->m_metadata->cols = colCnt[i];
+        part->m_metadata->rows = boundaries[i+1] - boundaries[i];
+        part->m_metadata->nz = nzCnt[i];
+        part->m_metadata->startingRow = boundaries[i];
+        part->m_metadata->startingCol = 0;
+        part->m_metadata->bytesPerInd = sizeof(SpMVInd);
+        part->m_metadata->bytesPerVal = A->isPatternOnly() ? 0 : sizeof(SpMVVal);
+        part->m_metadata->flags = 0;
+        part->m_fullCols = cols;
+        part->m_ownsData = (arena == 0);
+        part->m_indPtrs = HostArena::newArray<SpMVInd>(arena, colCnt[i]+1);
+        part->m_colInds = HostArena::newArray<SpMVInd>(arena, colCnt[i]);
+        part->m_inds = HostArena::newArray<SpMVInd>(arena, nzCnt[i]);
+        part->m_nzData = A->isPatternOnly() ? 0 : HostArena::newArray<SpMVVal>(arena, nzCnt[i]);
+        char partName[256];
+        CSC<SpMVInd, SpMVVal>::itoa(i, partName);
+        part->m_name = A->getName() + "-d" + std::string(partName);
+        res.push_back(part);
+        lastCol[i] = cols;
+        colCnt[i] = 0;
+        nzCnt[i] = 0;
+    }
+
+    // second pass: distribute the elements, opening a new compressed column
+    // in a partition whenever it sees its first element from a column
+    for(SpMVInd col = 0; col < cols; col++) {
+      for(SpMVInd elm = indPtrs[col]; elm < indPtrs[col+1]; elm++) {
+        SpMVInd currentInd = inds[elm];
+        unsigned int p = findPartition(boundaries, currentInd);
+        DCSC<SpMVInd, SpMVVal> * part = res[p];
+        if(lastCol[p] != col) {
+          part->m_colInds[colCnt[p]] = col;
+          part->m_indPtrs[colCnt[p]] = nzCnt[p];
+          colCnt[p]++;
+          lastCol[p] = col;
+        }
+        // elem index is "rebased" on the partition lower bound
+        part->m_inds[nzCnt[p]] = currentInd - boundaries[p];
+        if(part->m_nzData) part->m_nzData[nzCnt[p]] = nzData[elm];
+        nzCnt[p]++;
+      }
+    }
+    for(unsigned int p = 0; p < numPartitions; p++)
+      res[p]->m_indPtrs[colCnt[p]] = nzCnt[p];
+
+    return res;
+  }
+
+protected:
+  SpMVInd * m_colInds;
+  unsigned int m_fullCols;
+
+  // find the partition containing row index ind, given ascending boundaries
+  static unsigned int findPartition(const std::vector<SpMVInd> & boundaries, SpMVInd ind) {
+    return (std::upper_bound(boundaries.begin() + 1, boundaries.end() - 1, ind) - boundaries.begin()) - 1;
+  }
+};
+
+#endif // DCSC_HPP
@@ -0,0 +1,166 @@
+#ifndef HAZARDREORDER_HPP
+#define HAZARDREORDER_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include "csc.hpp"
+
+// marker for rows that have not been issued yet
+#define HAZARD_NEVER_ISSUED   (~((uint64_t) 0))
+
+// host-side model of the Seyrek reduction schedulers, plus a preprocessing
+// pass that reorders the nonzeros of a CSC matrix to reduce hazard stalls.
+//
+// the model: one nonzero enters the scheduler per cycle and stays in flight
+// (occupies one of the <issueWindow> slots) for <latency> cycles, which is
+// the time for context load -> add -> context save. a nonzero whose row index
+// is already in flight cannot enter, and each cycle spent waiting for this is
+// counted as a hazard stall, like hazardStallCycles in InOrderScheduler and
+// OoOComplScheduler.
+//
+// nonzeros can only be moved within their own column (so the CSC semantics
+// and the column pointers stay intact), but the reordering of each column
+// looks at the tail of the previous column and at the rows of the next one,
+// since hazards mostly arise around column boundaries.
+
+typedef struct {
+  uint64_t cycles;            // predicted cycles to get all nonzeros issued
+  uint64_t hazardStallCycles; // cycles lost waiting for same-row completion
+  uint64_t windowStallCycles; // cycles lost waiting for a free window slot
+} HazardPrediction;
+
+template <class SpMVInd, class SpMVVal>
+class HazardReorderer {
+public:
+  HazardReorderer(unsigned int issueWindow, unsigned int latency) {
+    if(issueWindow == 0 || latency == 0)
+      throw "issueWindow and latency must be nonzero in HazardReorderer";
+    m_issueWindow = issueWindow;
+    m_latency = latency;
+  }
+
+  // predict the stalls for issuing the nonzeros of A in storage order
+  HazardPrediction predict(CSC<SpMVInd, SpMVVal> * A) {
+    reset(A->getRows());
+    SpMVInd * colPtr = A->getIndPtrs();
+    SpMVInd * rowInds = A->getInds();
+    for(SpMVInd col = 0; col < A->getCols(); col++) {
+      for(SpMVInd ep = colPtr[col]; ep < colPtr[col+1]; ep++) {
+        issue(rowInds[ep]);
+      }
+    }
+    return m_pred;
+  }
+
+  // reorder the nonzeros inside each column of A (in-place) to reduce the
+  // predicted hazard stalls. returns the prediction for the new ordering.
+  HazardPrediction reorder(CSC<SpMVInd, SpMVVal> * A) {
+    reset(A->getRows());
+    SpMVInd * colPtr = A->getIndPtrs();
+    SpMVInd * rowInds = A->getInds();
+    SpMVVal * nzData = A->getNZData();
+    unsigned int cols = A->getCols();
+    // m_nextColMark[row] == col+1 means row also appears in column col+1
+    m_nextColMark.assign(A->getRows(), 0);
+    std::vector<ReorderEntry> entries;
+    std::vector<SpMVInd> tmpInds;
+    std::vector<SpMVVal> tmpData;
+
+    for(SpMVInd col = 0; col < cols; col++) {
+      SpMVInd start = colPtr[col], end = colPtr[col+1];
+      if(col + 1 < cols) {
+        for(SpMVInd ep = colPtr[col+1]; ep < colPtr[col+2]; ep++)
+          m_nextColMark[rowInds[ep]] = col + 1;
+      }
+      // rows within a column are unique, so the only hazards are against
+      // rows still in flight from previous columns: sort by the cycle the
+      // row becomes free, and issue rows needed by the next column early
+      entries.clear();
+      for(SpMVInd ep = start; ep < end; ep++) {
+        ReorderEntry e;
+        SpMVInd row = rowInds[ep];
+        e.freeAt = (m_lastIssue[row] == HAZARD_NEVER_ISSUED) ? 0 : m_lastIssue[row] + m_latency;
+        if(e.freeAt <= m_pred.cycles) e.freeAt = 0;
+        e.inNextCol = (m_nextColMark[row] == col + 1);
+        e.pos = ep;
+        entries.push_back(e);
+      }
+      std::stable_sort(entries.begin(), entries.end(), compareEntries);
+      // apply the permutation and simulate the issue of the new order
+      tmpInds.clear(); tmpData.clear();
+      for(unsigned int i = 0; i < entries.size(); i++) {
+        tmpInds.push_back(rowInds[entries[i].pos]);
+        if(nzData) tmpData.push_back(nzData[entries[i].pos]);
+      }
+      for(unsigned int i = 0; i < entries.size(); i++) {
+        rowInds[start + i] = tmpInds[i];
+        if(nzData) nzData[start + i] = tmpData[i];
+        issue(tmpInds[i]);
+      }
+    }
+    return m_pred;
+  }
+
+protected:
+  typedef struct {
+    uint64_t freeAt;
+    bool inNextCol;
+    SpMVInd pos;
+  } ReorderEntry;
+
+  static bool compareEntries(const ReorderEntry & a, const ReorderEntry & b) {
+    if(a.freeAt != b.freeAt) return a.freeAt < b.freeAt;
+    return a.inNextCol && !b.inNextCol;
+  }
+
+  unsigned int m_issueWindow;
+  unsigned int m_latency;
+  HazardPrediction m_pred;
+  // cycle at which each row was last issued
+  std::vector<uint64_t> m_lastIssue;
+  // completion cycles of the in-flight nonzeros, oldest first
+  std::vector<uint64_t> m_inFlight;
+  unsigned int m_inFlightHead;
+  std::vector<SpMVInd> m_nextColMark;
+
+  void reset(unsigned int rows) {
+    m_pred.cycles = 0;
+    m_pred.hazardStallCycles = 0;
+    m_pred.windowStallCycles = 0;
+    m_lastIssue.assign(rows, HAZARD_NEVER_ISSUED);
+    m_inFlight.clear();
+    m_inFlightHead = 0;
+  }
+
+  // advance the model by issuing one nonzero with the given row index
+  void issue(SpMVInd row) {
+    // retire everything that has completed by now
+    while(m_inFlightHead < m_inFlight.size() && m_inFlight[m_inFlightHead] <= m_pred.cycles)
+      m_inFlightHead++;
+    // wait for the same row to complete
+    if(m_lastIssue[row] != HAZARD_NEVER_ISSUED && m_lastIssue[row] + m_latency > m_pred.cycles) {
+      uint64_t wait = m_lastIssue[row] + m_latency - m_pred.cycles;
+      m_pred.hazardStallCycles += wait;
+      m_pred.cycles += wait;
+      while(m_inFlightHead < m_inFlight.size() && m_inFlight[m_inFlightHead] <= m_pred.cycles)
+        m_inFlightHead++;
+    }
+    // wait for a free slot in the issue window
+    if(m_inFlight.size() - m_inFlightHead >= m_issueWindow) {
+      uint64_t freeAt = m_inFlight[m_inFlight.size() - m_issueWindow];
+      m_pred.windowStallCycles += freeAt - m_pred.cycles;
+      m_pred.cycles = freeAt;
+    }
+    m_lastIssue[row] = m_pred.cycles;
+    m_inFlight.push_back(m_pred.cycles + m_latency);
+    m_pred.cycles++;
+    // keep the completion list from growing without bound
+    if(m_inFlightHead > 4096) {
+      m_inFlight.erase(m_inFlight.begin(), m_inFlight.begin() + m_inFlightHead);
+      m_inFlightHead = 0;
+    }
+  }
+};
+
+#endif // HAZARDREORDER_HPP
@@ -0,0 +1,83 @@
+#ifndef HOSTARENA_HPP
+#define HOSTARENA_HPP
+
+#include <stdint.h>
+#include <vector>
+
+// simple bump allocator for host-side arrays that live and die together,
+// such as the arrays of all partitions of a matrix. memory is taken from
+// large chunks and only given back when the whole arena is released.
+
+#define ARENA_DEFAULT_CHUNK   (16*1024*1024)
+#define ARENA_ALIGN           64
+
+class HostArena {
+public:
+  HostArena(uint64_t chunkSize = ARENA_DEFAULT_CHUNK) {
+    m_chunkSize = chunkSize;
+    m_used = 0;
+    m_bytesAllocated = 0;
+  }
+
+  virtual ~HostArena() {
+    release();
+  }
+
+  void * alloc(uint64_t numBytes) {
+    // round up to keep every allocation aligned
+    numBytes = (numBytes + ARENA_ALIGN - 1) & ~((uint64_t) ARENA_ALIGN - 1);
+    if(numBytes > m_chunkSize) {
+      // large requests get a chunk of their own, leave the current one be
+      char * big = newChunk(numBytes);
+      if(m_chunks.empty()) {
+        m_chunks.push_back(big);
+        m_used = m_chunkSize; // next small request starts a new chunk
+      } else
+        m_chunks.insert(m_chunks.end() - 1, big);
+      return align(big);
+    }
+    if(m_chunks.empty() || m_used + numBytes > m_chunkSize) {
+      m_chunks.push_back(newChunk(m_chunkSize));
+      m_used = 0;
+    }
+    void * ret = align(m_chunks.back()) + m_used;
+    m_used += numBytes;
+    return ret;
+  }
+
+  // free everything allocated from the arena
+  void release() {
+    for(unsigned int i = 0; i < m_chunks.size(); i++)
+      delete [] m_chunks[i];
+    m_chunks.clear();
+    m_used = 0;
+    m_bytesAllocated = 0;
+  }
+
+  uint64_t getBytesAllocated() const {return m_bytesAllocated;}
+
+  // allocate an array of count elements from the arena, or with new[] if
+  // no arena is given (the caller is then responsible for delete[])
+  template <class T>
+  static T * newArray(HostArena * arena, uint64_t count) {
+    if(arena) return (T *) arena->alloc(sizeof(T) * count);
+    else return new T[count];
+  }
+
+protected:
+  std::vector<char *> m_chunks;
+  uint64_t m_chunkSize;
+  uint64_t m_used;
+  uint64_t m_bytesAllocated;
+
+  char * newChunk(uint64_t numBytes) {
+    m_bytesAllocated += numBytes + ARENA_ALIGN;
+    return new char[numBytes + ARENA_ALIGN];
+  }
+
+  static char * align(char * p) {
+    return (char *)(((uintptr_t) p + ARENA_ALIGN - 1) & ~((uintptr_t) ARENA_ALIGN - 1));
+  }
+};
+
+#endif // HOSTARENA_HPP
@@ -5,26 +5,37 @@
 #include <vector>
 #include <string>
 #include <iostream>
+#include <string.h>
 using namespace std;
 
 #include "cscspmv.hpp"
 #include "wrapperregdriver.h"
+#include "accelbufferpool.hpp"
 #include "commonsemirings.hpp"
 #include "seyrekconsts.hpp"
 
 // number of registers per SpMV PE
-#define HWSPMVPE_REGS   19
+#define HWSPMVPE_REGS   27
 
 // TODO better control of acc-host buffer duplication in sw drivers --
 // right now there are two copies of all (host+accel) and coherency mvs.
 // are automatically called every time
 
-template <class SpMVInd, class SpMVVal>
-class HWSpMV : public virtual CSCSpMV<SpMVInd, SpMVVal>, public AddMulSemiring<SpMVInd, SpMVVal> {
+// the semiring is a template parameter: accelerators with a selectable
+// semiring unit are programmed to compute it, fixed-function accelerators
+// ignore the selection and always compute their own semiring
+template <class SpMVInd, class SpMVVal,
+          class SpMVSemiring = AddMulSemiring<SpMVInd, SpMVVal> >
+class HWSpMV : public virtual CSCSpMV<SpMVInd, SpMVVal>, public SpMVSemiring {
 public:
-  HWSpMV(WrapperRegDriver * driver, unsigned int peNum = 0, const char * attachName = 0) {
+  // accelerator buffers are taken from the given pool (which may be shared
+  // with other HWSpMVs), or from a private pool if none is given
+  HWSpMV(WrapperRegDriver * driver, unsigned int peNum = 0, const char * attachName = 0,
+         AccelBufferPool * pool = 0) {
     m_attachName = attachName;
     m_platform = driver;
+    m_ownsPool = (pool == 0);
+    m_pool = m_ownsPool ? new AccelBufferPool(driver) : pool;
     m_acc_indPtrs = 0;
     m_acc_inds = 0;
     m_acc_nzData = 0;
@@ -35,6 +46,11 @@ public:
     m_nzDataSize = 0;
     m_xSize = 0;
     m_ySize = 0;
+    m_sharedX = false;
+    m_sharedY = false;
+    m_hwPatternOnly = false;
+    m_hwExtContext = false;
+    m_hwLanes = 1;
     m_peNum = peNum;
     m_perfCtrIndMap = getPerfCtrMap();
     for(map<string,unsigned int>::iterator it = m_perfCtrIndMap.begin(); it != m_perfCtrIndMap.end(); ++it) {
@@ -44,58 +60,137 @@ public:
       m_platform->attach(attachName);
   }
 
-  virtual ~HWSpMV() {if(m_attachName !=0) m_platform->detach();}
+  virtual ~HWSpMV() {
+    releaseBuffers();
+    if(m_ownsPool) delete m_pool;
+    if(m_attachName !=0) m_platform->detach();
+  }
 
   virtual void setA(CSC<SpMVInd, SpMVVal> * A) {
-    // free the old accel buffers first, if alloc'd
-    if(m_acc_indPtrs != 0) {
-      m_platform->deallocAccelBuffer((void *) m_acc_indPtrs);
-      m_platform->deallocAccelBuffer((void *) m_acc_inds);
-      m_platform->deallocAccelBuffer((void *) m_acc_nzData);
-    }
-    if(m_acc_x) m_platform->deallocAccelBuffer((void *) m_acc_x);
-    if(m_acc_y) m_platform->deallocAccelBuffer((void *) m_acc_y);
+    // the nz register of the accelerator is 32 bits wide, larger matrices
+    // must be partitioned (e.g. with ParallelHWSpMV)
+    if(A->getNNZ() > 0xffffffffULL) throw "Too many nonzeros for one HWSpMV";
+    // the HW computes with the stored nonzeros only
+    if(A->isSymmetric()) throw "Symmetric matrices must be expanded for HWSpMV";
+    // give the old accel buffers back to the pool first, if alloc'd
+    releaseBuffers();
     // call base class impl
     CSCSpMV<SpMVInd, SpMVVal>::setA(A);
-    // calculate the associated buffer sizes
-    m_indPtrSize = sizeof(SpMVInd) * (m_A->getCols() + 1);
-    m_indSize = sizeof(SpMVInd) * m_A->getNNZ();
-    m_nzDataSize = sizeof(SpMVVal) * m_A->getNNZ();
-    m_xSize = sizeof(SpMVVal) * m_A->getCols();
-    m_ySize = sizeof(SpMVVal) * m_A->getRows();
+    // calculate the associated buffer sizes. multi-lane accelerators read
+    // rowind and nzdata in whole lane groups, so those are padded up to a
+    // multiple of the lane count
+    uint64_t nzPadded = ((m_A->getNNZ() + m_hwLanes - 1) / m_hwLanes) * m_hwLanes;
+    m_indPtrSize = sizeof(SpMVInd) * ((uint64_t) m_A->getCols() + 1);
+    m_indSize = sizeof(SpMVInd) * nzPadded;
+    m_nzDataSize = sizeof(SpMVVal) * nzPadded;
+    if(m_hwPatternOnly) {
+      // the accelerator does not read any values
+      if(!m_A->isPatternOnly()) throw "Pattern-only accelerator needs a pattern-only matrix";
+      m_nzDataSize = 0;
+    }
+    m_xSize = sizeof(SpMVVal) * (uint64_t) m_A->getCols();
+    m_ySize = sizeof(SpMVVal) * (uint64_t) m_A->getRows();
     // alloc new accel buffers
-    m_acc_indPtrs = (SpMVInd *) m_platform->allocAccelBuffer(m_indPtrSize);
-    m_acc_inds = (SpMVInd *) m_platform->allocAccelBuffer(m_indSize);
-    m_acc_nzData = (SpMVVal *) m_platform->allocAccelBuffer(m_nzDataSize);
-    m_acc_x = (SpMVVal *) m_platform->allocAccelBuffer(m_xSize);
-    m_acc_y = (SpMVVal *) m_platform->allocAccelBuffer(m_ySize);
+    m_acc_indPtrs = (SpMVInd *) m_pool->alloc(m_indPtrSize);
+    m_acc_inds = (SpMVInd *) m_pool->alloc(m_indSize);
+    if(!m_hwPatternOnly) m_acc_nzData = (SpMVVal *) m_pool->alloc(m_nzDataSize);
+    if(!m_sharedX) m_acc_x = (SpMVVal *) m_pool->alloc(m_xSize);
+    if(!m_sharedY) m_acc_y = (SpMVVal *) m_pool->alloc(m_ySize);
     // copy matrix data host -> accel
-    m_platform->copyBufferHostToAccel((void *)m_A->getIndPtrs(), (void *) m_acc_indPtrs, m_indPtrSize);
-    m_platform->copyBufferHostToAccel((void *)m_A->getInds(), (void *) m_acc_inds, m_indSize);
-    m_platform->copyBufferHostToAccel((void *)m_A->getNZData(), (void *) m_acc_nzData, m_nzDataSize);
+    m_platform->copyBufferHostToAccel64((void *)m_A->getIndPtrs(), (void *) m_acc_indPtrs, m_indPtrSize);
+    m_platform->copyBufferHostToAccel64((void *)m_A->getInds(), (void *) m_acc_inds, sizeof(SpMVInd) * m_A->getNNZ());
+    uploadLanePadding((void *) m_acc_inds, sizeof(SpMVInd), m_indSize);
+    if(!m_hwPatternOnly) {
+      if(m_A->isPatternOnly()) uploadOnes();
+      else m_platform->copyBufferHostToAccel64((void *)m_A->getNZData(), (void *) m_acc_nzData, sizeof(SpMVVal) * m_A->getNNZ());
+      uploadLanePadding((void *) m_acc_nzData, sizeof(SpMVVal), m_nzDataSize);
+    }
     // set up matrix metadata in the accelerator
     set_csc_colPtr((AccelDblReg) m_acc_indPtrs);
     set_csc_cols(m_A->getCols());
     set_csc_inpVec((AccelDblReg) m_acc_x);
-    set_csc_nz(m_A->getNNZ());
+    set_csc_nz((AccelReg) m_A->getNNZ());
     set_csc_nzData((AccelDblReg) m_acc_nzData);
     set_csc_outVec((AccelDblReg) m_acc_y);
     set_csc_rowInd((AccelDblReg) m_acc_inds);
     set_csc_rows(m_A->getRows());
+    set_semiringSel(hwSemiringSel());
+    set_contextInit(valBits(this->zero()));
   }
 
   virtual void setx(SpMVVal * x) {
     // call base class impl
     CSCSpMV<SpMVInd, SpMVVal>::setx(x);
-    // copy data
-    m_platform->copyBufferHostToAccel((void *)x, (void *)m_acc_x, m_xSize);
+    // copy data, unless the owner of the shared buffer takes care of it
+    if(!m_sharedX)
+      m_platform->copyBufferHostToAccel64((void *)x, (void *)m_acc_x, m_xSize);
   }
 
   virtual void sety(SpMVVal * y) {
     // call base class impl
     CSCSpMV<SpMVInd, SpMVVal>::sety(y);
-    // copy data host -> accel
-    m_platform->copyBufferHostToAccel((void *)y, (void *)m_acc_y, m_ySize);
+    // copy data host -> accel, unless the owner of the shared buffer does it.
+    // external context memories start from zeroes once a matrix is set
+    if(m_hwExtContext)
+      resetExtContexts();
+    else if(!m_sharedY)
+      m_platform->copyBufferHostToAccel64((void *)y, (void *)m_acc_y, m_ySize);
+  }
+
+  // use an accelerator-side input vector owned (allocated, uploaded and
+  // freed) by someone else, e.g. one x shared between several PEs.
+  // must be called before setA, passing 0 goes back to a private buffer.
+  void setSharedInpVec(SpMVVal * acc_x) {
+    if(m_acc_x && !m_sharedX) m_pool->release((void *) m_acc_x);
+    m_acc_x = acc_x;
+    m_sharedX = (acc_x != 0);
+    if(m_sharedX) set_csc_inpVec((AccelDblReg) m_acc_x);
+  }
+
+  // use an accelerator-side output vector owned by someone else, acc_y
+  // should point to the region for the rows of this PE. the flush writes
+  // whole memory beats, so the region must have room for the rows rounded
+  // up to a beat. must be called before setA.
+  void setSharedOutVec(SpMVVal * acc_y) {
+    if(m_acc_y && !m_sharedY) m_pool->release((void *) m_acc_y);
+    m_acc_y = acc_y;
+    m_sharedY = (acc_y != 0);
+    if(m_sharedY) set_csc_outVec((AccelDblReg) m_acc_y);
+  }
+
+  // set if the accelerator was built with patternOnly, and does not read
+  // the nzdata stream. must be called before setA.
+  void setHWPatternOnly(bool patternOnly) {
+    m_hwPatternOnly = patternOnly;
+  }
+
+  // set if the accelerator keeps its contexts in the output vector in main
+  // memory (ExtContextMem, CachedContextMem). those compute y + Ax for the
+  // y found there, so sety uploads the semiring zero instead of y (also to
+  // a shared output vector) to get y = Ax like with on-chip contexts.
+  void setHWExtContext(bool extContext) {
+    m_hwExtContext = extContext;
+  }
+
+  bool isHWExtContext() const {
+    return m_hwExtContext;
+  }
+
+  // fill the output vector of external context memories with the semiring
+  // zero again, needed before each run since the HW adds Ax to it. exec()
+  // does this through sety, owners of a shared output vector call it.
+  void resetExtContexts() {
+    if(m_hwExtContext && m_A) uploadZeroes();
+  }
+
+  // set to the frontendLanes of the accelerator. the rowind and nzdata
+  // buffers are then padded with zeroes up to a multiple of the lanes, the
+  // accelerator reads the padding but does not compute with it.
+  // must be called before setA.
+  void setHWLanes(unsigned int lanes) {
+    if(lanes == 0 || (lanes & (lanes - 1)) != 0)
+      throw "Accelerator lane count must be a power of two";
+    m_hwLanes = lanes;
   }
 
   virtual bool exec() {
@@ -125,10 +220,39 @@ public:
       cout << m_perfCtrKeys[i] << " = " << m_perfCtrValMap[m_perfCtrKeys[i]] << endl;
   }
 
+  // descriptor-based job submission, for accelerators built with jobQueue
+  // (see SpMVJobQueue). fills d with the current matrix and vectors.
+  void makeJobDescriptor(SpMVJobDescriptor & d, unsigned int modes) {
+    if(!m_A) throw "No matrix assigned for job descriptor";
+    d.colPtr = (AccelDblReg) m_acc_indPtrs;
+    d.rowInd = (AccelDblReg) m_acc_inds;
+    d.nzData = (AccelDblReg) m_acc_nzData;
+    d.inpVec = (AccelDblReg) m_acc_x;
+    d.outVec = (AccelDblReg) m_acc_y;
+    d.rows = m_A->getRows();
+    d.cols = m_A->getCols();
+    d.nz = (uint32_t) m_A->getNNZ();
+    d.modes = modes;
+    d.semiringSel = hwSemiringSel();
+  }
+
+  void setJobQueue(void * acc_ring, unsigned int slots) {
+    set_jobQueueBase((AccelDblReg) acc_ring);
+    set_jobQueueSlots(slots);
+  }
+
+  void ringJobDoorbell(unsigned int tail) {
+    set_jobTail(tail);
+  }
+
+  unsigned int getJobHead() {
+    return get_jobHead();
+  }
+
   // HWSpMV-specific functions
   void copyOutputToHost() {
     // copy back y data to the host side
-    m_platform->copyBufferAccelToHost((void *)m_acc_y, (void *)m_y, m_ySize);
+    m_platform->copyBufferAccelToHost64((void *)m_acc_y, (void *)m_y, m_ySize);
   }
 
   virtual bool isFinished() {
@@ -162,6 +286,8 @@ protected:
   using CSCSpMV<SpMVInd, SpMVVal>::m_x;
 
   WrapperRegDriver * m_platform;
+  AccelBufferPool * m_pool;
+  bool m_ownsPool;
   const char * m_attachName;
   unsigned int m_peNum;
 
@@ -187,7 +313,15 @@ protected:
     offsNZ          = 16,
     offsCtxTxns	    = 17,
     offsCtrSel      = 18,
-    offsCtrVal      = 19
+    offsCtrVal      = 19,
+    offsSemiringSel = 20,
+    offsJobQueueHi  = 21,
+    offsJobQueueLo  = 22,
+    offsJobSlots    = 23,
+    offsJobTail     = 24,
+    offsJobHead     = 25,
+    offsCtxInitHi   = 26,
+    offsCtxInitLo   = 27
   } HWSpMVReg;
   // readReg and writeReg use peNum to add a base offset to the desired register ID
   AccelReg readReg(HWSpMVReg reg) {return m_platform->readReg(m_peNum * HWSPMVPE_REGS + reg);}
@@ -208,6 +342,13 @@ protected:
   void set_ctx_txns(AccelReg value) {writeReg(offsCtxTxns, value);}
   void set_perfCtrSel(AccelReg value) {writeReg(offsCtrSel, value);}
   AccelReg get_perfCtrVal() {return readReg(offsCtrVal);}
+  // add op in bits 3..0, mul op in bits 7..4
+  void set_semiringSel(AccelReg value) {writeReg(offsSemiringSel, value);}
+  void set_jobQueueBase(AccelDblReg value) { writeReg(offsJobQueueHi, (AccelReg)(value >> 32)); writeReg(offsJobQueueLo, (AccelReg)(value & 0xffffffff)); }
+  void set_jobQueueSlots(AccelReg value) {writeReg(offsJobSlots, value);}
+  void set_jobTail(AccelReg value) {writeReg(offsJobTail, value);}
+  AccelReg get_jobHead() {return readReg(offsJobHead);}
+  void set_contextInit(AccelDblReg value) { writeReg(offsCtxInitHi, (AccelReg)(value >> 32)); writeReg(offsCtxInitLo, (AccelReg)(value & 0xffffffff)); }
 
   // accelerator-side versions of SpMV data
   SpMVInd * m_acc_indPtrs;
@@ -215,11 +356,74 @@ protected:
   SpMVVal * m_acc_nzData;
   SpMVVal * m_acc_x;
   SpMVVal * m_acc_y;
-  unsigned int m_indPtrSize;
-  unsigned int m_indSize;
-  unsigned int m_nzDataSize;
-  unsigned int m_xSize;
-  unsigned int m_ySize;
+  uint64_t m_indPtrSize;
+  uint64_t m_indSize;
+  uint64_t m_nzDataSize;
+  uint64_t m_xSize;
+  uint64_t m_ySize;
+  // whether x and y are shared buffers, owned by someone else
+  bool m_sharedX;
+  bool m_sharedY;
+  // whether the accelerator skips the nzdata stream
+  bool m_hwPatternOnly;
+  // whether the accelerator accumulates into the output vector in memory
+  bool m_hwExtContext;
+  // number of frontend lanes of the accelerator
+  unsigned int m_hwLanes;
+
+  // semiringSel value for the semiring, add op in bits 3..0 and mul op in
+  // bits 7..4. the HW would compute something else for unknown op codes
+  AccelReg hwSemiringSel() {
+    SemiringAddOp addOp = this->hwAddOp();
+    SemiringMulOp mulOp = this->hwMulOp();
+    if((unsigned int) addOp > SEMIRING_ADD_OR || (unsigned int) mulOp > SEMIRING_MUL_AND)
+      throw "Unknown semiring op code for the accelerator";
+    return addOp | (mulOp << 4);
+  }
+
+  // the bits of a value, zero-extended to 64 bits for a value register
+  static AccelDblReg valBits(SpMVVal v) {
+    AccelDblReg bits = 0;
+    memcpy(&bits, &v, sizeof(SpMVVal) < sizeof(bits) ? sizeof(SpMVVal) : sizeof(bits));
+    return bits;
+  }
+
+  // accelerators that read nzdata get explicit ones for pattern-only matrices
+  void uploadOnes() {
+    SpMVVal * ones = new SpMVVal[m_A->getNNZ()];
+    for(uint64_t i = 0; i < m_A->getNNZ(); i++)
+      ones[i] = this->one();
+    m_platform->copyBufferHostToAccel64((void *)ones, (void *) m_acc_nzData, sizeof(SpMVVal) * m_A->getNNZ());
+    delete [] ones;
+  }
+
+  // zero the lane padding after the nonzeros in a rowind or nzdata buffer
+  void uploadLanePadding(void * accBuf, uint64_t elemBytes, uint64_t bufBytes) {
+    uint64_t used = elemBytes * m_A->getNNZ();
+    if(bufBytes == used) return;
+    std::vector<char> zeroes(bufBytes - used, 0);
+    m_platform->copyBufferHostToAccel64((void *) &zeroes[0], (void *)((char *) accBuf + used), bufBytes - used);
+  }
+
+  // start the contexts of external context memories from the semiring zero
+  void uploadZeroes() {
+    SpMVVal * zeroes = new SpMVVal[m_A->getRows()];
+    for(uint64_t i = 0; i < m_A->getRows(); i++)
+      zeroes[i] = this->zero();
+    m_platform->copyBufferHostToAccel64((void *)zeroes, (void *) m_acc_y, m_ySize);
+    delete [] zeroes;
+  }
+
+  void releaseBuffers() {
+    if(m_acc_indPtrs != 0) {
+      m_pool->release((void *) m_acc_indPtrs);
+      m_pool->release((void *) m_acc_inds);
+      if(m_acc_nzData) m_pool->release((void *) m_acc_nzData);
+      m_acc_indPtrs = 0; m_acc_inds = 0; m_acc_nzData = 0;
+    }
+    if(m_acc_x && !m_sharedX) {m_pool->release((void *) m_acc_x); m_acc_x = 0;}
+    if(m_acc_y && !m_sharedY) {m_pool->release((void *) m_acc_y); m_acc_y = 0;}
+  }
 
   void execAccelMode(SeyrekModes mode) {
     // TODO ensure finished before starting new commands!
@@ -0,0 +1,125 @@
+#ifndef JOBQUEUE_HPP
+#define JOBQUEUE_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include "wrapperregdriver.h"
+#include "accelbufferpool.hpp"
+#include "hwcscspmv.hpp"
+#include "seyrekconsts.hpp"
+
+// host side of the job descriptor ring of one PE (see JobQueueEngine.scala).
+// jobs are staged on the host with post(), and submit() copies them into
+// the ring and rings the doorbell with a single register write. the
+// accelerator then runs the jobs back to back, without the per-mode
+// register writes and finished polling of HWSpMV::exec.
+// job numbers increase by one per posted job (and wrap around at 2^32),
+// a job is finished when the head register has moved past it.
+
+template <class SpMVInd, class SpMVVal,
+          class SpMVSemiring = AddMulSemiring<SpMVInd, SpMVVal> >
+class SpMVJobQueue {
+public:
+  SpMVJobQueue(WrapperRegDriver * driver, HWSpMV<SpMVInd, SpMVVal, SpMVSemiring> * pe,
+               AccelBufferPool * pool, unsigned int slots = 64) {
+    if(slots == 0 || (slots & (slots - 1)) != 0)
+      throw "SpMVJobQueue slots must be a power of two";
+    m_platform = driver;
+    m_pe = pe;
+    m_pool = pool;
+    m_slots = slots;
+    m_ringSize = sizeof(SpMVJobSlot) * (uint64_t) slots;
+    m_hostRing = new SpMVJobSlot[slots];
+    memset(m_hostRing, 0, m_ringSize);
+    m_accRing = (SpMVJobSlot *) m_pool->alloc(m_ringSize);
+    m_platform->copyBufferHostToAccel64((void *) m_hostRing, (void *) m_accRing, m_ringSize);
+    // the hardware head starts from 0 after reset, continue from there
+    m_head = m_pe->getJobHead();
+    m_tail = m_head;
+    m_submitted = m_head;
+    m_pe->setJobQueue((void *) m_accRing, slots);
+  }
+
+  virtual ~SpMVJobQueue() {
+    m_pool->release((void *) m_accRing);
+    delete [] m_hostRing;
+  }
+
+  // stage a job for the current matrix and vectors of the PE, running the
+  // given modes (SEYREK_JOB_*). returns the job number.
+  unsigned int post(unsigned int modes = SEYREK_JOB_ALL) {
+    // make room if the ring is full of unfinished jobs
+    if(m_tail - m_head >= m_slots) {
+      submit();
+      waitJob(m_tail - m_slots);
+    }
+    SpMVJobSlot & s = m_hostRing[m_tail & (m_slots - 1)];
+    memset(&s, 0, sizeof(s));
+    m_pe->makeJobDescriptor(s.desc, modes);
+    return m_tail++;
+  }
+
+  // copy the staged jobs into the ring and ring the doorbell
+  void submit() {
+    if(m_submitted == m_tail) return;
+    // the staged slots may wrap around the end of the ring
+    while(m_submitted != m_tail) {
+      unsigned int first = m_submitted & (m_slots - 1);
+      unsigned int count = m_tail - m_submitted;
+      if(first + count > m_slots) count = m_slots - first;
+      m_platform->copyBufferHostToAccel64((void *) &m_hostRing[first],
+        (void *) &m_accRing[first], sizeof(SpMVJobSlot) * (uint64_t) count);
+      m_submitted += count;
+    }
+    m_pe->ringJobDoorbell(m_tail);
+  }
+
+  bool isFinished(unsigned int jobNum) {
+    if(jobNum - m_head < m_tail - m_head)
+      m_head = m_pe->getJobHead();
+    return (jobNum - m_head) >= (m_tail - m_head);
+  }
+
+  // TODO sleep/yield while waiting?
+  void waitJob(unsigned int jobNum) {
+    while(!isFinished(jobNum));
+  }
+
+  void waitAll() {
+    submit();
+    while(m_head != m_tail) m_head = m_pe->getJobHead();
+  }
+
+  // completion record of a finished job, which is only available until the
+  // ring wraps around to its slot again
+  SpMVJobCompletion getCompletion(unsigned int jobNum) {
+    if(!isFinished(jobNum)) throw "Job not finished yet";
+    if(m_tail - jobNum > m_slots) throw "Job completion record overwritten";
+    SpMVJobCompletion c;
+    m_platform->copyBufferAccelToHost64((void *) &m_accRing[jobNum & (m_slots - 1)].completion,
+      (void *) &c, sizeof(c));
+    return c;
+  }
+
+  static const char * counterName(unsigned int i) {
+    static const char * names[SEYREK_JOB_COUNTERS] = {"cycleCount",
+      "hazardStallCycles", "bypassCount", "coalescedMerges",
+      "contextCacheHits", "contextCacheMisses"};
+    return i < SEYREK_JOB_COUNTERS ? names[i] : "";
+  }
+
+protected:
+  WrapperRegDriver * m_platform;
+  HWSpMV<SpMVInd, SpMVVal, SpMVSemiring> * m_pe;
+  AccelBufferPool * m_pool;
+  unsigned int m_slots;
+  uint64_t m_ringSize;
+  SpMVJobSlot * m_hostRing;
+  SpMVJobSlot * m_accRing;
+  // job numbers: finished (as last read), staged, and copied to the ring
+  unsigned int m_head;
+  unsigned int m_tail;
+  unsigned int m_submitted;
+};
+
+#endif // JOBQUEUE_HPP
@@ -1,114 +1,277 @@
 #include <iostream>
 #include "swcscspmv.hpp"
+#include "swsymcscspmv.hpp"
 #include "hwcscspmv.hpp"
 #include "commonsemirings.hpp"
 #include "platform.h"
 #include <string.h>
+#include <stdio.h>
+#include <unistd.h>
 #include "parallelspmv.hpp"
+#include "autotuner.hpp"
 
 using namespace std;
 
 typedef unsigned int SpMVInd;
+// build with -DSEYREK_VAL32 for accelerators with 32-bit values
+#ifdef SEYREK_VAL32
+typedef int32_t SpMVVal;
+#else
 typedef int64_t SpMVVal;
+#endif
 
 
-class RegSpMV: public AddMulSemiring<SpMVInd, SpMVVal>, public SWSpMV<SpMVInd, SpMVVal> {
+// SW SpMV over the semiring of the run, for checking the HW results
+template <class SpMVSemiring>
+class RegSpMV: public SpMVSemiring, public SWSpMV<SpMVInd, SpMVVal> {
 public:
   virtual unsigned int statInt(std::string name) { return 0;}
 
   virtual std::vector<std::string> statKeys() {
     vector<string> keys;
     keys.push_back("matrix");
+    return keys;
   }
 };
 
-int main(int argc, char *argv[])
-{
+template <class SpMVSemiring>
+class RegSymSpMV: public SpMVSemiring, public SWSymSpMV<SpMVInd, SpMVVal> {
+public:
+  virtual unsigned int statInt(std::string name) { return 0;}
+
+  virtual std::vector<std::string> statKeys() {
+    vector<string> keys;
+    keys.push_back("matrix");
+    return keys;
+  }
+};
+
+typedef struct {
+  unsigned int numPEs;
+  unsigned int lanes;
+  unsigned int reorderWindow;
+  unsigned int reorderLatency;
+  unsigned int jobSlots;      // 0 for register control of the PEs
+  bool extContext;
+  bool autotune;
+  bool patternOnly;
+  const char * cacheDir;      // 0 for no partition cache
+} RunOptions;
+
+void showHelp(const char * prog) {
+  cerr << "Usage: " << prog << " [-p numPEs] [-a] [-e] [-l lanes] [-r window,latency]" << endl;
+  cerr << "       [-s semiring] [-n] [-j slots] [cacheDir]" << endl;
+  cerr << "  -p: number of PEs to use (default 1)" << endl;
+  cerr << "  -a: autotune, using up to the number of PEs given with -p" << endl;
+  cerr << "  -e: the accelerator keeps its contexts in main memory" << endl;
+  cerr << "      (external or cached context memory)" << endl;
+  cerr << "  -l: number of frontend lanes of the accelerator (default 1)" << endl;
+  cerr << "  -r: hazard-aware nonzero reordering for the given scheduler" << endl;
+  cerr << "      issue window and context load-add-save latency" << endl;
+  cerr << "  -s: semiring, addmul (default), minplus or orand. other than" << endl;
+  cerr << "      addmul needs an accelerator built for it or a selectable one" << endl;
+  cerr << "  -n: pattern-only accelerator (no nzdata stream), the matrix values" << endl;
+  cerr << "      are dropped. uses the orand semiring unless -s is given" << endl;
+  cerr << "  -j: submit the work through job descriptor rings with the given" << endl;
+  cerr << "      number of slots, for accelerators built with a job queue" << endl;
+  cerr << "  cacheDir: directory for caching the preprocessed partitions" << endl;
+  cerr << "      (and the autotuner results)" << endl;
+}
+
+// read the matrix and attach name, run SpMV over SpMVSemiring with the
+// given options and check the result against SW. returns the exit status.
+template <class SpMVSemiring>
+int runSpMV(const RunOptions & opts) {
   typedef CSC<SpMVInd, SpMVVal> SparseMatrix;
-  typedef HWSpMV<SpMVInd, SpMVVal> HardwareSpMV;
-  typedef ParallelHWSpMV<SpMVInd, SpMVVal> ParSpMV;
+  typedef ParallelHWSpMV<SpMVInd, SpMVVal, SpMVSemiring> ParSpMV;
 
-  try {
-    string matrixName;
-    cout << "Enter matrix name: " << endl;
-    cin >> matrixName;
-
-    SparseMatrix * A;
-    unsigned int dim = 0;
-    if (matrixName == "eye") {
-      cout << "Enter dimension for identity matrix: " << endl;
-      cin >> dim;
-      A = SparseMatrix::eye(dim);
-    } else if (matrixName == "dense") {
-      cout << "Enter dimension for dense matrix: " << endl;
-      cin >> dim;
-      A = SparseMatrix::dense(dim);
-    } else
-      A = SparseMatrix::load(matrixName);
-
-    A->printSummary();
-    SpMVVal * x = new SpMVVal[A->getCols()];
-    SpMVVal * y = new SpMVVal[A->getRows()];
-    for(int i = 0; i < A->getRows(); i++) {
-        x[i] = 1;
-        y[i] = 0;
-    }
+  unsigned int numPEs = opts.numPEs;
+  string matrixName;
+  cout << "Enter matrix name: " << endl;
+  cin >> matrixName;
 
+  SparseMatrix * A;
+  unsigned int dim = 0;
+  if (matrixName == "eye") {
+    cout << "Enter dimension for identity matrix: " << endl;
+    cin >> dim;
+    A = SparseMatrix::eye(dim);
+  } else if (matrixName == "dense") {
+    cout << "Enter dimension for dense matrix: " << endl;
+    cin >> dim;
+    A = SparseMatrix::dense(dim);
+  } else if (matrixName == "rowruns") {
+    unsigned int runLength = 1;
+    cout << "Enter dimension for same-row runs matrix: " << endl;
+    cin >> dim;
+    cout << "Enter run length: " << endl;
+    cin >> runLength;
+    A = SparseMatrix::rowRuns(dim, runLength);
+  } else
+    A = SparseMatrix::load(matrixName);
 
-    WrapperRegDriver * platform = initPlatform();
-    string attachname;
-    cout << "Enter attach name: " << endl;
-    cin >> attachname;
+  if(opts.patternOnly) A->dropValues();
+  A->printSummary();
+  // every third element of x is the semiring zero, e.g. an unreachable
+  // vertex for minplus or one outside the frontier for orand
+  SpMVSemiring sr;
+  SpMVVal * x = new SpMVVal[A->getCols()];
+  SpMVVal * y = new SpMVVal[A->getRows()];
+  for(unsigned int i = 0; i < A->getCols(); i++) {
+      x[i] = (i % 3 == 2) ? sr.zero() : sr.one();
+  }
+  for(unsigned int i = 0; i < A->getRows(); i++) {
+      y[i] = sr.zero();
+  }
 
-    ParSpMV * par = new ParSpMV(1, platform, attachname.c_str());
 
-    cout << "Setting inputs..." << endl;
+  WrapperRegDriver * platform = initPlatform();
+  string attachname;
+  cout << "Enter attach name: " << endl;
+  cin >> attachname;
 
-    par->setA(A);
-    par->setx(x);
-    par->sety(y);
+  PartitionCache<SpMVInd, SpMVVal> * cache = 0;
+  string tuneDB = "seyrek-autotune.txt";
+  if(opts.cacheDir) {
+    cache = new PartitionCache<SpMVInd, SpMVVal>(opts.cacheDir);
+    tuneDB = string(opts.cacheDir) + "/" + tuneDB;
+  }
+
+  CSCSpMV<SpMVInd, SpMVVal> * spmv;
+  ParSpMV * par;
+  if(opts.autotune) {
+    // pick the fastest configuration for this matrix, from a previous
+    // run if there is one
+    SpMVAutotuner<SpMVInd, SpMVVal, SpMVSemiring> tuner(platform, attachname, numPEs, tuneDB);
+    tuner.setPartitionCache(cache);
+    if(opts.reorderWindow != 0) tuner.setHazardModel(opts.reorderWindow, opts.reorderLatency);
+    tuner.setHWExtContext(opts.extContext);
+    tuner.setHWLanes(opts.lanes);
+    SpMVTuneConfig cfg = tuner.tune(A);
+    spmv = tuner.create(cfg, A->isSymmetric());
+    // 0 if the SW SpMV was the fastest
+    par = dynamic_cast<ParSpMV *>(spmv);
+    numPEs = cfg.numPEs;
+  } else {
+    par = new ParSpMV(numPEs, platform, attachname.c_str());
+    par->setPartitionCache(cache);
+    par->setHazardReorder(opts.reorderWindow, opts.reorderLatency);
+    par->setHWExtContext(opts.extContext);
+    par->setHWLanes(opts.lanes);
+    par->setHWPatternOnly(opts.patternOnly);
+    if(opts.jobSlots != 0) par->setJobQueue(opts.jobSlots);
+    spmv = par;
+  }
 
-    cout << "Executing..." << endl;
+  cout << "Setting inputs..." << endl;
 
+  spmv->setA(A);
+  spmv->setx(x);
+  spmv->sety(y);
 
-    par->exec();
+  cout << "Executing..." << endl;
 
-    par->getPE(0)->printAllStats();
 
-    cout << "Completed, checking result..." << endl;
+  spmv->exec();
 
-    RegSpMV chk;
-    chk.setA(A);
-    chk.setx(x);
-    SpMVVal * goldeny = new SpMVVal[A->getRows()];
-    for(int i = 0; i < A->getRows(); i++) {
-        goldeny[i] = 0;
+  if(par) {
+    for(unsigned int pe = 0; pe < numPEs; pe++) {
+      cout << "PE " << pe << " stats:" << endl;
+      par->getPE(pe)->printAllStats();
     }
-    chk.sety(goldeny);
-    chk.exec();
-    int res = memcmp(y, goldeny, A->getRows() * sizeof(SpMVVal));
-    cout << "memcmp result: " << res << endl;
+    cout << "cyclesRegular (slowest PE) = " << par->statInt("cyclesRegular") << endl;
+    par->getBufferPool()->printStats();
+  }
 
-    if(res != 0)
-      for(int i = 0; i < A->getRows(); i++) {
-        if(goldeny[i] != y[i]) cout << i << " golden: " << goldeny[i] << " res: " << y[i] << endl;
-      }
+  cout << "Completed, checking result..." << endl;
 
-    delete par;
-    delete [] x;
-    delete [] y;
-    delete [] goldeny;
-    delete A;
+  // symmetric matrices store one triangle, and need their own SW kernel
+  CSCSpMV<SpMVInd, SpMVVal> * chk;
+  if(A->isSymmetric()) chk = new RegSymSpMV<SpMVSemiring>();
+  else chk = new RegSpMV<SpMVSemiring>();
+  chk->setA(A);
+  chk->setx(x);
+  SpMVVal * goldeny = new SpMVVal[A->getRows()];
+  for(unsigned int i = 0; i < A->getRows(); i++) {
+      goldeny[i] = sr.zero();
+  }
+  chk->sety(goldeny);
+  chk->exec();
+  int res = memcmp(y, goldeny, A->getRows() * sizeof(SpMVVal));
+  cout << "memcmp result: " << res << endl;
 
+  if(res != 0)
+    for(unsigned int i = 0; i < A->getRows(); i++) {
+      if(goldeny[i] != y[i]) cout << i << " golden: " << goldeny[i] << " res: " << y[i] << endl;
+    }
+
+  delete chk;
+  delete spmv;
+  delete cache;
+  delete [] x;
+  delete [] y;
+  delete [] goldeny;
+  delete A;
 
-    deinitPlatform(platform);
 
-    return 0;
+  deinitPlatform(platform);
+
+  // nonzero exit status on mismatch, for scripted runs
+  return res == 0 ? 0 : 1;
+}
 
+int main(int argc, char *argv[])
+{
+  RunOptions opts;
+  opts.numPEs = 1;
+  opts.lanes = 1;
+  opts.reorderWindow = 0;
+  opts.reorderLatency = 0;
+  opts.jobSlots = 0;
+  opts.extContext = false;
+  opts.autotune = false;
+  opts.patternOnly = false;
+  opts.cacheDir = 0;
+  string semiring;
+  int opt;
+  while((opt = getopt(argc, argv, "ap:el:r:s:nj:h")) != -1) {
+    bool ok = true;
+    if(opt == 'e') opts.extContext = true;
+    else if(opt == 'a') opts.autotune = true;
+    else if(opt == 'n') opts.patternOnly = true;
+    else if(opt == 'p') ok = sscanf(optarg, "%u", &opts.numPEs) == 1 && opts.numPEs > 0;
+    else if(opt == 'l') ok = sscanf(optarg, "%u", &opts.lanes) == 1 && opts.lanes > 0;
+    else if(opt == 'j') ok = sscanf(optarg, "%u", &opts.jobSlots) == 1 && opts.jobSlots > 0;
+    else if(opt == 'r') ok = sscanf(optarg, "%u,%u", &opts.reorderWindow, &opts.reorderLatency) == 2;
+    else if(opt == 's') semiring = optarg;
+    else ok = false;
+    if(!ok) {
+      showHelp(argv[0]);
+      return 2;
+    }
+  }
+  if(semiring.empty()) semiring = opts.patternOnly ? "orand" : "addmul";
+  // the autotuner does not set up pattern-only or job queue accelerators
+  if(opts.autotune && (opts.patternOnly || opts.jobSlots != 0)) {
+    cerr << "-a can not be combined with -n or -j" << endl;
+    showHelp(argv[0]);
+    return 2;
+  }
+  if(optind < argc) opts.cacheDir = argv[optind];
+
+  try {
+    if(semiring == "addmul")
+      return runSpMV<AddMulSemiring<SpMVInd, SpMVVal> >(opts);
+    else if(semiring == "minplus")
+      return runSpMV<MinPlusSemiring<SpMVInd, SpMVVal> >(opts);
+    else if(semiring == "orand")
+      return runSpMV<BoolOrAndSemiring<SpMVInd, SpMVVal> >(opts);
+    cerr << "Unknown semiring " << semiring << endl;
+    showHelp(argv[0]);
+    return 2;
   } catch(char const * err) {
     cerr << "Exception: " << err << endl;
     return 1;
   }
 
 }
-
@@ -5,12 +5,24 @@
 using namespace std;
 
 #include <vector>
+#include <algorithm>
 #include "cscspmv.hpp"
 #include "hwcscspmv.hpp"
+#include "hazardreorder.hpp"
+#include "dcsc.hpp"
+#include "accelbufferpool.hpp"
+#include "hostarena.hpp"
+#include "partitioncache.hpp"
+#include "jobqueue.hpp"
+#include "cscdelta.hpp"
 #include "commonsemirings.hpp"
 #include "seyrekconsts.hpp"
 
 #define MAX_HWSPMV_PE   64
+// the y region of each PE in the shared y starts at a multiple of this many
+// bytes, so that the flush bursts of a PE stay within 4 KB pages and the
+// whole beats it writes at the end of its rows do not reach the next PE
+#define HWSPMV_Y_ALIGN  4096
 
 // a simple driver for handling multiple HWSpMVs executing an SpMV
 // operation in parallel
@@ -23,48 +35,141 @@ using namespace std;
 // - callback-based PE completion
 // - async exec?
 
-template <class SpMVInd, class SpMVVal>
-class ParallelHWSpMV : public virtual CSCSpMV<SpMVInd, SpMVVal>, public AddMulSemiring<SpMVInd, SpMVVal> {
+template <class SpMVInd, class SpMVVal,
+          class SpMVSemiring = AddMulSemiring<SpMVInd, SpMVVal> >
+class ParallelHWSpMV : public virtual CSCSpMV<SpMVInd, SpMVVal>, public SpMVSemiring {
 public:
   ParallelHWSpMV(unsigned int numPEs, WrapperRegDriver * driver,
                  const char * attachName) {
+    if(numPEs == 0 || numPEs > MAX_HWSPMV_PE)
+      throw "Unsupported number of PEs in ParallelHWSpMV";
     m_attachName = attachName;
     m_platform = driver;
+    m_pool = new AccelBufferPool(driver);
     m_numPEs = numPEs;
+    m_reorderWindow = 0;
+    m_reorderLatency = 0;
+    m_hypersparse = false;
+    m_scheme = PARTITION_EQUAL_ROWS;
+    m_cache = 0;
+    m_deltaMergeRatio = 0.05;
+    m_acc_x = 0;
+    m_acc_y = 0;
+    m_xSize = 0;
     for(unsigned int pe = 0; pe < m_numPEs; pe++) {
-        m_pe[pe] = new HWSpMV<SpMVInd, SpMVVal>(driver, pe);
+        m_pe[pe] = new HWSpMV<SpMVInd, SpMVVal, SpMVSemiring>(driver, pe, 0, m_pool);
+        m_peX[pe] = 0;
+        m_jobs[pe] = 0;
+        m_jobCycles[pe] = 0;
     }
     m_platform->attach(attachName);
   }
 
   virtual ~ParallelHWSpMV() {
-    m_platform->detach();
     for(unsigned int pe = 0; pe < m_numPEs; pe++) {
+        delete m_jobs[pe];
         delete m_pe[pe];
+        delete [] m_peX[pe];
     }
+    // frees all accelerator buffers, including the shared x and y
+    delete m_pool;
+    freePartitions();
+    m_platform->detach();
   }
 
   virtual void setA(CSC<SpMVInd, SpMVVal> * A) {
+    // every PE gets at least one row
+    if(A->getRows() < m_numPEs) throw "More PEs than matrix rows in ParallelHWSpMV";
     CSCSpMV<SpMVInd, SpMVVal>::setA(A);
-    // create the partitions
-    m_partitions = A->partition(m_numPEs);
+    // create the partitions, the old ones are not needed anymore
+    freePartitions();
+    for(unsigned int pe = 0; pe < m_numPEs; pe++)
+      m_delta[pe].clear();
+    PartitionCacheKey key;
+    key.numPartitions = m_numPEs;
+    key.scheme = m_scheme;
+    key.format = m_hypersparse ? PARTITION_FORMAT_DCSC : PARTITION_FORMAT_CSC;
+    key.reorderWindow = m_reorderWindow;
+    key.reorderLatency = m_reorderLatency;
+    if(!m_cache || !m_cache->load(A, key, &m_partitionArena, m_partitions)) {
+      // the HW needs both triangles of symmetric matrices, expand them
+      // (temporarily) before partitioning. cache entries are still looked
+      // up with the symmetric matrix, which is cheaper to fingerprint.
+      CSC<SpMVInd, SpMVVal> * fullA = A;
+      if(A->isSymmetric()) fullA = A->expandSymmetric();
+      std::vector<SpMVInd> boundaries;
+      if(m_scheme == PARTITION_NNZ_BALANCED)
+        boundaries = fullA->calcNNZBoundaries(m_numPEs);
+      else
+        boundaries = fullA->calcDivBoundaries(m_numPEs);
+      if(m_hypersparse) {
+        std::vector<DCSC<SpMVInd, SpMVVal> * > dparts = DCSC<SpMVInd, SpMVVal>::partition(fullA, boundaries, &m_partitionArena);
+        m_partitions.assign(dparts.begin(), dparts.end());
+      } else
+        m_partitions = fullA->partition(boundaries, &m_partitionArena);
+      if(fullA != A) delete fullA;
+      // reorder nonzeros within the partitions to avoid scheduler stalls
+      if(m_reorderWindow != 0) {
+        HazardReorderer<SpMVInd, SpMVVal> reorderer(m_reorderWindow, m_reorderLatency);
+        for(unsigned int pe = 0; pe < m_numPEs; pe++) {
+          reorderer.reorder(m_partitions[pe]);
+        }
+      }
+      if(m_cache) m_cache->store(A, key, m_partitions);
+    }
+    // allocate the accelerator-side x and y shared by all PEs. hypersparse
+    // partitions use gathered per-PE input vectors instead of the shared x.
+    if(m_acc_x) m_pool->release((void *) m_acc_x);
+    if(m_acc_y) m_pool->release((void *) m_acc_y);
+    m_acc_x = 0;
+    m_xSize = sizeof(SpMVVal) * (uint64_t) A->getCols();
+    // each PE gets its own padded and aligned region in the shared y
+    uint64_t accYSize = 0;
+    for(unsigned int pe = 0; pe < m_numPEs; pe++) {
+      m_yOffs[pe] = accYSize / sizeof(SpMVVal);
+      uint64_t peYSize = sizeof(SpMVVal) * (uint64_t) m_partitions[pe]->getRows();
+      accYSize += (peYSize + HWSPMV_Y_ALIGN - 1) & ~((uint64_t) HWSPMV_Y_ALIGN - 1);
+    }
+    if(!m_hypersparse)
+      m_acc_x = (SpMVVal *) m_pool->alloc(m_xSize);
+    m_acc_y = (SpMVVal *) m_pool->alloc(accYSize);
     // assign the partitions to PEs
     for(unsigned int pe = 0; pe < m_numPEs; pe++) {
+      m_pe[pe]->setSharedInpVec(m_acc_x);
+      m_pe[pe]->setSharedOutVec(m_acc_y + m_yOffs[pe]);
       m_pe[pe]->setA(m_partitions[pe]);
+      // hypersparse partitions get their own gathered input vector
+      delete [] m_peX[pe];
+      m_peX[pe] = 0;
+      if(m_hypersparse)
+        m_peX[pe] = new SpMVVal[m_partitions[pe]->getCols()];
     }
   }
 
   virtual void setx(SpMVVal * x) {
     CSCSpMV<SpMVInd, SpMVVal>::setx(x);
+    // upload the shared input vector once for all PEs
+    if(!m_hypersparse)
+      m_platform->copyBufferHostToAccel64((void *)x, (void *)m_acc_x, m_xSize);
     // assign input vector for each PE
-    // TODO dont't mke multiple copies of input vector
     for(unsigned int pe = 0; pe < m_numPEs; pe++) {
-      m_pe[pe]->setx(x);
+      if(m_hypersparse) {
+        // only the elements for the non-empty columns are sent
+        DCSC<SpMVInd, SpMVVal> * dpart = (DCSC<SpMVInd, SpMVVal> *) m_partitions[pe];
+        dpart->gatherInput(x, m_peX[pe]);
+        m_pe[pe]->setx(m_peX[pe]);
+      } else
+        m_pe[pe]->setx(x);
     }
   }
 
   virtual void sety(SpMVVal * y) {
     CSCSpMV<SpMVInd, SpMVVal>::sety(y);
+    // scatter the rows of each PE into its region of the shared y. PEs
+    // with external context memory fill their region with zeroes instead
+    // (again in each exec).
+    for(unsigned int pe = 0; pe < m_numPEs; pe++)
+      if(!m_pe[pe]->isHWExtContext()) copyPEOutVec(pe, true);
     // assign rebased output vector for each PE
     for(unsigned int pe = 0; pe < m_numPEs; pe++) {
       m_pe[pe]->sety(&y[m_partitions[pe]->getStartingRow()]);
@@ -72,23 +177,151 @@ public:
   }
 
   virtual bool exec() {
-    execForAll(START_INIT);
-    execForAll(START_REGULAR);
-    execForAll(START_FLUSH);
+    // pending removals and large deltas are merged into the partitions,
+    // the remaining insertions are added to y after the HW is done
+    for(unsigned int pe = 0; pe < m_numPEs; pe++) {
+      if(m_delta[pe].hasRemovals() ||
+         m_delta[pe].size() > m_deltaMergeRatio * m_partitions[pe]->getNNZ())
+        mergeDelta(pe);
+    }
+    // external context memories still hold the previous y + Ax
+    for(unsigned int pe = 0; pe < m_numPEs; pe++)
+      m_pe[pe]->resetExtContexts();
+    if(m_jobs[0]) execJobs();
+    else {
+      execForAll(START_INIT);
+      execForAll(START_REGULAR);
+      execForAll(START_FLUSH);
+    }
 
+    // gather the rows of all PEs from the shared y
     for(unsigned int pe = 0; pe < m_numPEs; pe++) {
-      m_pe[pe]->copyOutputToHost();
+      copyPEOutVec(pe, false);
+      execDelta(pe);
     }
     return true;
   }
 
-  HWSpMV<SpMVInd, SpMVVal> * getPE(unsigned int ind) {
+  // update the nonzeros of the matrix set by setA, e.g. edges of a dynamic
+  // graph (see CSCDelta for the semantics). the changes are collected per
+  // partition and merged by exec() when needed, so that only the partitions
+  // that changed are rebuilt and uploaded again. the matrix passed to setA
+  // itself is not modified.
+  // the partitions of symmetric matrices hold both triangles, so updates of
+  // those are applied at (row, col) and at the mirrored (col, row).
+  void insertNonzero(SpMVInd row, SpMVInd col, SpMVVal val) {
+    unsigned int pe = findUpdatePE(row, col);
+    m_delta[pe].insert(row - m_partitions[pe]->getStartingRow(), col, val);
+    if(this->m_A->isSymmetric() && row != col) {
+      pe = findUpdatePE(col, row);
+      m_delta[pe].insert(col - m_partitions[pe]->getStartingRow(), row, val);
+    }
+  }
+
+  void removeNonzero(SpMVInd row, SpMVInd col) {
+    unsigned int pe = findUpdatePE(row, col);
+    m_delta[pe].remove(row - m_partitions[pe]->getStartingRow(), col);
+    if(this->m_A->isSymmetric() && row != col) {
+      pe = findUpdatePE(col, row);
+      m_delta[pe].remove(col - m_partitions[pe]->getStartingRow(), row);
+    }
+  }
+
+  // merge all pending updates now
+  void mergeUpdates() {
+    for(unsigned int pe = 0; pe < m_numPEs; pe++)
+      mergeDelta(pe);
+  }
+
+  // exec() merges the updates of a partition once they exceed this fraction
+  // of its nonzeros, smaller deltas are computed in software
+  void setDeltaMergeRatio(double ratio) {
+    m_deltaMergeRatio = ratio;
+  }
+
+  // enable hazard-aware nonzero reordering for partitions created by setA,
+  // using the issue window and context load-add-save latency of the HW.
+  // set issueWindow to 0 to disable.
+  void setHazardReorder(unsigned int issueWindow, unsigned int latency) {
+    m_reorderWindow = issueWindow;
+    m_reorderLatency = latency;
+  }
+
+  // use hypersparse (DCSC) partitions in the following setA calls, so that
+  // the partition memory scales with nz instead of numPEs * cols. the HW
+  // processes each partition as a CSC matrix over its non-empty columns,
+  // and setx gathers the matching input vector elements for each PE.
+  void setHypersparse(bool enable) {
+    m_hypersparse = enable;
+  }
+
+  // how setA splits the rows between the PEs
+  void setPartitionScheme(PartitionScheme scheme) {
+    m_scheme = scheme;
+  }
+
+  void setOutstandingTxns(unsigned int txns) {
+    for(unsigned int pe = 0; pe < m_numPEs; pe++)
+      m_pe[pe]->setOutstandingTxns(txns);
+  }
+
+  // set if the accelerator was built with patternOnly (no nzdata stream),
+  // see HWSpMV::setHWPatternOnly. must be called before setA.
+  void setHWPatternOnly(bool patternOnly) {
+    for(unsigned int pe = 0; pe < m_numPEs; pe++)
+      m_pe[pe]->setHWPatternOnly(patternOnly);
+  }
+
+  // set if the accelerator keeps its contexts in the output vector in main
+  // memory, see HWSpMV::setHWExtContext
+  void setHWExtContext(bool extContext) {
+    for(unsigned int pe = 0; pe < m_numPEs; pe++)
+      m_pe[pe]->setHWExtContext(extContext);
+  }
+
+  // set to the frontendLanes of the accelerator, see HWSpMV::setHWLanes.
+  // must be called before setA.
+  void setHWLanes(unsigned int lanes) {
+    for(unsigned int pe = 0; pe < m_numPEs; pe++)
+      m_pe[pe]->setHWLanes(lanes);
+  }
+
+  // look up and store the partitions created by setA in the given on-disk
+  // cache, or pass 0 to always partition from scratch
+  void setPartitionCache(PartitionCache<SpMVInd, SpMVVal> * cache) {
+    m_cache = cache;
+  }
+
+  // submit the work to the PEs through job descriptor rings with the given
+  // number of slots (see SpMVJobQueue), which needs an accelerator built
+  // with jobQueue. this takes one register write per PE to start and no
+  // per-mode handshakes. set slots to 0 to go back to register control.
+  void setJobQueue(unsigned int slots) {
+    for(unsigned int pe = 0; pe < m_numPEs; pe++) {
+      delete m_jobs[pe];
+      m_jobs[pe] = 0;
+      if(slots != 0)
+        m_jobs[pe] = new SpMVJobQueue<SpMVInd, SpMVVal, SpMVSemiring>(m_platform, m_pe[pe], m_pool, slots);
+    }
+  }
+
+  // the pool all accelerator buffers of this SpMV are allocated from
+  AccelBufferPool * getBufferPool() {
+    return m_pool;
+  }
+
+  HWSpMV<SpMVInd, SpMVVal, SpMVSemiring> * getPE(unsigned int ind) {
 	  return m_pe[ind];
   }
 
   // TODO expose proper stats
   virtual unsigned int statInt(std::string name) {
-    if(name == "cyclesRegular") return findMaxPEStat(name);
+    // the slowest PE determines the total run time
+    if(name == "cyclesRegular") {
+      // the PE counters are not read back in job mode, use the completions
+      if(m_jobs[0]) return *std::max_element(m_jobCycles, m_jobCycles + m_numPEs);
+      return findMaxPEStat(findPEStatKey("cycleCount"));
+    }
     else return 0;
   }
 
@@ -100,11 +333,52 @@ public:
   }
 
 protected:
+  using CSCSpMV<SpMVInd, SpMVVal>::m_y;
+
   unsigned int m_numPEs;
   const char * m_attachName;
-  HWSpMV<SpMVInd, SpMVVal> * m_pe[MAX_HWSPMV_PE];
+  HWSpMV<SpMVInd, SpMVVal, SpMVSemiring> * m_pe[MAX_HWSPMV_PE];
   WrapperRegDriver * m_platform;
+  AccelBufferPool * m_pool;
   std::vector<CSC<SpMVInd, SpMVVal> * > m_partitions;
+  // the partition arrays live here and are all freed together
+  HostArena m_partitionArena;
+  unsigned int m_reorderWindow;
+  unsigned int m_reorderLatency;
+  bool m_hypersparse;
+  PartitionScheme m_scheme;
+  PartitionCache<SpMVInd, SpMVVal> * m_cache;
+  // gathered input vectors for hypersparse partitions
+  SpMVVal * m_peX[MAX_HWSPMV_PE];
+  // job descriptor rings, all 0 when using register control
+  SpMVJobQueue<SpMVInd, SpMVVal, SpMVSemiring> * m_jobs[MAX_HWSPMV_PE];
+  unsigned int m_jobCycles[MAX_HWSPMV_PE];
+  // pending nonzero updates for each partition
+  CSCDelta<SpMVInd, SpMVVal> m_delta[MAX_HWSPMV_PE];
+  double m_deltaMergeRatio;
+  // accelerator-side x and y, shared between all PEs
+  SpMVVal * m_acc_x;
+  SpMVVal * m_acc_y;
+  uint64_t m_xSize;
+  // start of the region of each PE in the shared y, in elements
+  uint64_t m_yOffs[MAX_HWSPMV_PE];
+
+  void freePartitions() {
+    for(unsigned int i = 0; i < m_partitions.size(); i++)
+      delete m_partitions[i];
+    m_partitions.clear();
+    m_partitionArena.release();
+  }
+
+  // copy the rows of a PE between y and its region of the shared y
+  void copyPEOutVec(unsigned int pe, bool toAccel) {
+    SpMVVal * hostY = m_y + m_partitions[pe]->getStartingRow();
+    uint64_t peYSize = sizeof(SpMVVal) * (uint64_t) m_partitions[pe]->getRows();
+    if(toAccel)
+      m_platform->copyBufferHostToAccel64((void *)hostY, (void *)(m_acc_y + m_yOffs[pe]), peYSize);
+    else
+      m_platform->copyBufferAccelToHost64((void *)(m_acc_y + m_yOffs[pe]), (void *)hostY, peYSize);
+  }
 
   bool isAllPEsFinished() {
     bool allFinished = true;
@@ -128,6 +402,64 @@ protected:
     }
   }
 
+  unsigned int findUpdatePE(SpMVInd row, SpMVInd col) {
+    if(m_partitions.empty()) throw "No matrix assigned for nonzero updates";
+    if(m_hypersparse) throw "Nonzero updates are not supported for hypersparse partitions";
+    if(row >= this->m_A->getRows() || col >= this->m_A->getCols())
+      throw "Nonzero update out of matrix bounds";
+    unsigned int pe = m_numPEs - 1;
+    while(row < m_partitions[pe]->getStartingRow()) pe--;
+    return pe;
+  }
+
+  // replace the partition of a PE with one that has the delta merged in,
+  // and upload only that one
+  void mergeDelta(unsigned int pe) {
+    if(m_delta[pe].empty()) return;
+    CSC<SpMVInd, SpMVVal> * merged = m_delta[pe].merge(m_partitions[pe]);
+    m_delta[pe].clear();
+    if(m_reorderWindow != 0) {
+      HazardReorderer<SpMVInd, SpMVVal> reorderer(m_reorderWindow, m_reorderLatency);
+      reorderer.reorder(merged);
+    }
+    delete m_partitions[pe];
+    m_partitions[pe] = merged;
+    m_pe[pe]->setA(merged);
+  }
+
+  // add the contribution of the pending insertions to y
+  void execDelta(unsigned int pe) {
+    const std::vector<typename CSCDelta<SpMVInd, SpMVVal>::DeltaEntry> & ins = m_delta[pe].getInsertions();
+    SpMVInd startingRow = m_partitions[pe]->getStartingRow();
+    bool patternOnly = m_partitions[pe]->isPatternOnly();
+    for(unsigned int i = 0; i < ins.size(); i++) {
+      SpMVInd row = startingRow + ins[i].row, col = ins[i].col;
+      SpMVVal val = patternOnly ? this->one() : ins[i].val;
+      SpMVVal mulRes = this->mul(val, this->m_x[col], row, col);
+      m_y[row] = this->add(m_y[row], mulRes, row, col);
+    }
+  }
+
+  void execJobs() {
+    unsigned int jobNum[MAX_HWSPMV_PE];
+    for(unsigned int pe = 0; pe < m_numPEs; pe++) {
+      jobNum[pe] = m_jobs[pe]->post(SEYREK_JOB_ALL);
+      m_jobs[pe]->submit();
+    }
+    for(unsigned int pe = 0; pe < m_numPEs; pe++) {
+      m_jobs[pe]->waitJob(jobNum[pe]);
+      m_jobCycles[pe] = (unsigned int) m_jobs[pe]->getCompletion(jobNum[pe]).counters[0];
+    }
+  }
+
+  // full name of the PE performance counter starting with prefix
+  std::string findPEStatKey(std::string prefix) {
+    std::vector<std::string> keys = m_pe[0]->statKeys();
+    for(unsigned int i = 0; i < keys.size(); i++)
+      if(keys[i].compare(0, prefix.size(), prefix) == 0) return keys[i];
+    return prefix;
+  }
+
   unsigned int findMaxPEStat(std::string key) {
 	unsigned int foundMax = 0;
 	unsigned int foundID = 0;
@@ -0,0 +1,285 @@
+#ifndef PARTITIONCACHE_HPP
+#define PARTITIONCACHE_HPP
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "csc.hpp"
+#include "dcsc.hpp"
+#include "hostarena.hpp"
+
+// persistent on-disk cache of preprocessed partitions, so that repeated runs
+// on the same matrix can skip partitioning (and nonzero reordering).
+// each cache file holds the partitions of one matrix for one partitioning
+// configuration (the key), as ready-to-upload images: the arrays of each
+// partition are stored exactly as they are copied to the accelerator, each
+// 64-byte aligned, so the whole file is read with a single fread into one
+// arena block and the partitions point directly into it.
+// the file also stores a fingerprint of the source matrix contents, and is
+// rebuilt when the source matrix changes.
+
+typedef enum {
+  PARTITION_EQUAL_ROWS = 0,
+  PARTITION_NNZ_BALANCED = 1
+} PartitionScheme;
+
+typedef enum {
+  PARTITION_FORMAT_CSC = 0,
+  PARTITION_FORMAT_DCSC = 1
+} PartitionFormat;
+
+typedef struct {
+  uint32_t numPartitions;
+  uint32_t scheme;          // PartitionScheme
+  uint32_t format;          // PartitionFormat
+  uint32_t reorderWindow;   // hazard reordering parameters, 0 if not used
+  uint32_t reorderLatency;
+} PartitionCacheKey;
+
+#define PARTITIONCACHE_MAGIC    0x3243505259455330ULL // "0SEYRPC2"
+#define PARTITIONCACHE_ALIGN    64
+
+typedef struct {
+  uint64_t magic;
+  uint64_t fingerprint;     // of the source matrix
+  uint32_t bytesPerInd;
+  uint32_t bytesPerVal;
+  PartitionCacheKey key;
+  uint32_t reserved;
+  uint64_t payloadBytes;    // size of everything after the header
+} PartitionCacheHeader;
+
+typedef struct {
+  uint32_t rows;
+  uint32_t cols;            // non-empty columns for DCSC
+  uint64_t nz;
+  uint32_t startingRow;
+  uint32_t fullCols;
+} PartitionImageHeader;
+
+template <class SpMVInd, class SpMVVal>
+class PartitionCache {
+public:
+  PartitionCache(std::string cacheDir) {
+    m_cacheDir = cacheDir;
+  }
+
+  virtual ~PartitionCache() {}
+
+  // try to load the partitions of A for the given key. on a hit, returns true
+  // and fills parts with matrices whose arrays live in the arena. truncated
+  // or corrupt files are treated as a miss.
+  bool load(CSC<SpMVInd, SpMVVal> * A, PartitionCacheKey key, HostArena * arena,
+            std::vector<CSC<SpMVInd, SpMVVal> * > & parts) {
+    FILE * f = fopen(fileName(A, key).c_str(), "rb");
+    if(!f) return false;
+    PartitionCacheHeader hdr;
+    bool valid = (fread(&hdr, sizeof(hdr), 1, f) == 1);
+    valid = valid && hdr.magic == PARTITIONCACHE_MAGIC;
+    valid = valid && hdr.bytesPerInd == sizeof(SpMVInd) && hdr.bytesPerVal == bytesPerVal(A);
+    valid = valid && memcmp(&hdr.key, &key, sizeof(key)) == 0;
+    valid = valid && hdr.fingerprint == fingerprint(A);
+    // the payload must be exactly the rest of the file
+    long hdrEnd = ftell(f);
+    valid = valid && fseek(f, 0, SEEK_END) == 0 && hdrEnd >= 0 &&
+            (uint64_t) (ftell(f) - hdrEnd) == hdr.payloadBytes &&
+            fseek(f, hdrEnd, SEEK_SET) == 0;
+    char * payload = 0;
+    if(valid) {
+      payload = (char *) arena->alloc(hdr.payloadBytes);
+      valid = (fread(payload, 1, hdr.payloadBytes, f) == hdr.payloadBytes);
+    }
+    fclose(f);
+    if(!valid) return false;
+
+    parts.clear();
+    uint64_t offs = 0, limit = hdr.payloadBytes;
+    for(unsigned int p = 0; p < key.numPartitions; p++) {
+      // check that all arrays of the partition are within the payload
+      // before they are touched
+      uint64_t imgOffs = offs;
+      if(!skip(offs, sizeof(PartitionImageHeader), 1, limit)) break;
+      PartitionImageHeader * ph = (PartitionImageHeader *) (payload + imgOffs);
+      uint64_t indPtrOffs = offs, colIndOffs = 0, indOffs = 0, nzDataOffs = 0;
+      bool ok = skip(offs, sizeof(SpMVInd), (uint64_t) ph->cols + 1, limit);
+      if(key.format == PARTITION_FORMAT_DCSC) {
+        colIndOffs = offs;
+        ok = ok && skip(offs, sizeof(SpMVInd), ph->cols, limit);
+      }
+      indOffs = offs;
+      ok = ok && skip(offs, sizeof(SpMVInd), ph->nz, limit);
+      nzDataOffs = offs;
+      // pattern-only matrices have no values
+      if(hdr.bytesPerVal != 0)
+        ok = ok && skip(offs, sizeof(SpMVVal), ph->nz, limit);
+      ok = ok && ((SpMVInd *) (payload + indPtrOffs))[ph->cols] == ph->nz;
+      if(!ok) break;
+      SparseMatrixMetadata * md = new SparseMatrixMetadata;
+      md->rows = ph->rows;
+      md->cols = ph->cols;
+      md->nz = ph->nz;
+      md->startingRow = ph->startingRow;
+      md->startingCol = 0;
+      md->bytesPerInd = sizeof(SpMVInd);
+      md->bytesPerVal = hdr.bytesPerVal;
+      md->flags = 0;
+      SpMVInd * indPtrs = (SpMVInd *) (payload + indPtrOffs);
+      SpMVInd * colInds = 0;
+      if(key.format == PARTITION_FORMAT_DCSC)
+        colInds = (SpMVInd *) (payload + colIndOffs);
+      SpMVInd * inds = (SpMVInd *) (payload + indOffs);
+      SpMVVal * nzData = 0;
+      if(hdr.bytesPerVal != 0)
+        nzData = (SpMVVal *) (payload + nzDataOffs);
+      std::string name = A->getName() + "-c" + toString(p);
+      if(key.format == PARTITION_FORMAT_DCSC)
+        parts.push_back(DCSC<SpMVInd, SpMVVal>::fromArrays(md, ph->fullCols,
+          indPtrs, colInds, inds, nzData, false, name));
+      else
+        parts.push_back(CSC<SpMVInd, SpMVVal>::fromArrays(md, indPtrs, inds,
+          nzData, false, name));
+    }
+    if(parts.size() != key.numPartitions) {
+      std::cerr << "Ignoring corrupt partition cache file " << fileName(A, key) << std::endl;
+      for(unsigned int p = 0; p < parts.size(); p++)
+        delete parts[p];
+      parts.clear();
+      return false;
+    }
+    return true;
+  }
+
+  // write the partitions of A for the given key into the cache, replacing
+  // any previous entry. failures are reported but not fatal.
+  void store(CSC<SpMVInd, SpMVVal> * A, PartitionCacheKey key,
+             const std::vector<CSC<SpMVInd, SpMVVal> * > & parts) {
+    std::string fn = fileName(A, key);
+    FILE * f = fopen(fn.c_str(), "wb");
+    if(!f) {
+      std::cerr << "Could not write partition cache file " << fn << std::endl;
+      return;
+    }
+    PartitionCacheHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = PARTITIONCACHE_MAGIC;
+    hdr.fingerprint = fingerprint(A);
+    hdr.bytesPerInd = sizeof(SpMVInd);
+    hdr.bytesPerVal = bytesPerVal(A);
+    hdr.key = key;
+    hdr.payloadBytes = 0;
+    // the payload size is only known at the end, rewrite the header then
+    bool ok = (fwrite(&hdr, sizeof(hdr), 1, f) == 1);
+    for(unsigned int p = 0; p < parts.size() && ok; p++) {
+      CSC<SpMVInd, SpMVVal> * part = parts[p];
+      PartitionImageHeader ph;
+      memset(&ph, 0, sizeof(ph));
+      ph.rows = part->getRows();
+      ph.cols = part->getCols();
+      ph.nz = part->getNNZ();
+      ph.startingRow = part->getStartingRow();
+      ph.fullCols = ph.cols;
+      if(key.format == PARTITION_FORMAT_DCSC)
+        ph.fullCols = ((DCSC<SpMVInd, SpMVVal> *) part)->getFullCols();
+      ok = ok && writeAligned(f, hdr.payloadBytes, &ph, sizeof(ph));
+      ok = ok && writeAligned(f, hdr.payloadBytes, part->getIndPtrs(), sizeof(SpMVInd) * ((uint64_t) ph.cols + 1));
+      if(key.format == PARTITION_FORMAT_DCSC)
+        ok = ok && writeAligned(f, hdr.payloadBytes,
+                                ((DCSC<SpMVInd, SpMVVal> *) part)->getColInds(),
+                                sizeof(SpMVInd) * ph.cols);
+      ok = ok && writeAligned(f, hdr.payloadBytes, part->getInds(), sizeof(SpMVInd) * ph.nz);
+      if(hdr.bytesPerVal != 0)
+        ok = ok && writeAligned(f, hdr.payloadBytes, part->getNZData(), sizeof(SpMVVal) * ph.nz);
+    }
+    ok = ok && (fseek(f, 0, SEEK_SET) == 0) && (fwrite(&hdr, sizeof(hdr), 1, f) == 1);
+    fclose(f);
+    if(!ok) {
+      std::cerr << "Error writing partition cache file " << fn << std::endl;
+      remove(fn.c_str());
+    }
+  }
+
+  // fingerprint of the matrix dimensions, storage flags and contents, used
+  // to detect when the source matrix of a cache entry has changed (64-bit
+  // FNV-1a variant working on whole words). the lower triangle of a
+  // symmetric matrix has the same arrays as a plain triangular matrix, so
+  // the symmetric flag is part of it.
+  static uint64_t fingerprint(CSC<SpMVInd, SpMVVal> * A) {
+    uint64_t h = 14695981039346656037ULL;
+    uint64_t dims[4] = {A->getRows(), A->getCols(), A->getNNZ(),
+                        A->isSymmetric() ? SPARSEMATRIX_SYMMETRIC : 0};
+    h = hashBytes(h, dims, sizeof(dims));
+    h = hashBytes(h, A->getIndPtrs(), sizeof(SpMVInd) * ((uint64_t) A->getCols() + 1));
+    h = hashBytes(h, A->getInds(), sizeof(SpMVInd) * A->getNNZ());
+    if(!A->isPatternOnly())
+      h = hashBytes(h, A->getNZData(), sizeof(SpMVVal) * A->getNNZ());
+    return h;
+  }
+
+protected:
+  std::string m_cacheDir;
+
+  std::string fileName(CSC<SpMVInd, SpMVVal> * A, PartitionCacheKey key) {
+    // matrix names may contain path separators, keep the file in the cache
+    std::string name = A->getName();
+    for(unsigned int i = 0; i < name.size(); i++)
+      if(name[i] == '/' || name[i] == '\\') name[i] = '_';
+    std::string fn = m_cacheDir + "/" + name;
+    fn += "-p" + toString(key.numPartitions);
+    fn += "-s" + toString(key.scheme);
+    fn += "-f" + toString(key.format);
+    if(key.reorderWindow != 0)
+      fn += "-r" + toString(key.reorderWindow) + "x" + toString(key.reorderLatency);
+    return fn + ".pcache";
+  }
+
+  static uint32_t bytesPerVal(CSC<SpMVInd, SpMVVal> * A) {
+    return A->isPatternOnly() ? 0 : sizeof(SpMVVal);
+  }
+
+  static uint64_t alignUp(uint64_t offs) {
+    return (offs + PARTITIONCACHE_ALIGN - 1) & ~((uint64_t) PARTITIONCACHE_ALIGN - 1);
+  }
+
+  // advance offs past count elements of elemBytes each (and the alignment
+  // padding), returns false if they do not fit within limit
+  static bool skip(uint64_t & offs, uint64_t elemBytes, uint64_t count, uint64_t limit) {
+    if(offs > limit || count > (limit - offs) / elemBytes) return false;
+    offs = alignUp(offs + elemBytes * count);
+    return true;
+  }
+
+  // write numBytes from buf, followed by zero padding up to the alignment
+  static bool writeAligned(FILE * f, uint64_t & offs, const void * buf, uint64_t numBytes) {
+    static const char zeroes[PARTITIONCACHE_ALIGN] = {0};
+    if(numBytes != 0 && fwrite(buf, 1, numBytes, f) != numBytes) return false;
+    uint64_t padding = alignUp(offs + numBytes) - (offs + numBytes);
+    if(padding != 0 && fwrite(zeroes, 1, padding, f) != padding) return false;
+    offs = alignUp(offs + numBytes);
+    return true;
+  }
+
+  static uint64_t hashBytes(uint64_t h, const void * buf, uint64_t numBytes) {
+    const uint64_t prime = 1099511628211ULL;
+    const unsigned char * p = (const unsigned char *) buf;
+    uint64_t i = 0;
+    for(; i + 8 <= numBytes; i += 8) {
+      uint64_t w;
+      memcpy(&w, p + i, 8);
+      h = (h ^ w) * prime;
+    }
+    for(; i < numBytes; i++)
+      h = (h ^ p[i]) * prime;
+    return h;
+  }
+
+  static std::string toString(unsigned int n) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%u", n);
+    return std::string(buf);
+  }
+};
+
+#endif // PARTITIONCACHE_HPP
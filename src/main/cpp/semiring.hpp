@@ -4,12 +4,35 @@
 // abstract base class template for defining semiring add and mul
 // note that the op coordinates are also passed to the implementations,
 // if the user wants to specialize the operations based on coordinate
-// TODO also expose semiring's own 0 and 1 definitions
+// the semiring's own 0 and 1 default to the arithmetic ones, and are used
+// e.g. as the implicit value of pattern-only matrices (one)
+// semirings that an accelerator with a runtime-selectable semiring unit can
+// compute report the matching op codes (see SemiringOps in Semiring.scala)
+
+typedef enum {
+  SEMIRING_ADD_PLUS = 0,
+  SEMIRING_ADD_MIN = 1,
+  SEMIRING_ADD_MAX = 2,
+  SEMIRING_ADD_OR = 3
+} SemiringAddOp;
+
+typedef enum {
+  SEMIRING_MUL_TIMES = 0,
+  SEMIRING_MUL_PLUS = 1,
+  SEMIRING_MUL_AND = 2
+} SemiringMulOp;
 
 template <class SpMVInd, class SpMVVal>
 class Semiring {
 public:
   virtual ~Semiring() {};
+  // identity of add
+  virtual SpMVVal zero() {return (SpMVVal) 0;}
+  // identity of mul
+  virtual SpMVVal one() {return (SpMVVal) 1;}
+  // op codes for the selectable semiring unit
+  virtual SemiringAddOp hwAddOp() {return SEMIRING_ADD_PLUS;}
+  virtual SemiringMulOp hwMulOp() {return SEMIRING_MUL_TIMES;}
 protected:
   virtual SpMVVal mul(SpMVVal first, SpMVVal second, SpMVInd row, SpMVInd col) = 0;
   virtual SpMVVal add(SpMVVal first, SpMVVal second, SpMVInd row, SpMVInd col) = 0;
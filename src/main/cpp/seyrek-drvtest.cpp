@@ -0,0 +1,241 @@
+#include <iostream>
+#include <stdio.h>
+#include <vector>
+#include <stdint.h>
+#include "wrapperregdriver.h"
+#include "accelbufferpool.hpp"
+#include "csc.hpp"
+#include "swcscspmv.hpp"
+#include "commonsemirings.hpp"
+
+// stand-alone test for the 64-bit buffer paths of WrapperRegDriver and
+// AccelBufferPool, using a mock driver that only records the calls. the
+// buffers are never touched, so sizes above 4 GB can be tested without
+// having that much memory. also checks the row partitioning of small
+// matrices over many PEs and min-plus SpMV on unreachable vertices. needs no accelerator or matrix files:
+// g++ -I. seyrek-drvtest.cpp -o seyrek-drvtest
+
+using namespace std;
+
+// only generated matrices are used
+void * readMatrixData(std::string name, std::string component, uint64_t * numBytes) {
+  throw "No matrix files in seyrek-drvtest";
+}
+
+#define GB  (1ULL << 30)
+
+typedef struct {
+  uint64_t host;
+  uint64_t accel;
+  uint64_t numBytes;
+} MockCopy;
+
+class MockDriver : public WrapperRegDriver {
+public:
+  MockDriver() {
+    m_nextBuffer = 0x100000000000ULL;
+    m_allocs = 0;
+  }
+
+  virtual void copyBufferHostToAccel(void * hostBuffer, void * accelBuffer, unsigned int numBytes) {
+    recordCopy(hostBuffer, accelBuffer, numBytes);
+  }
+  virtual void copyBufferAccelToHost(void * accelBuffer, void * hostBuffer, unsigned int numBytes) {
+    recordCopy(hostBuffer, accelBuffer, numBytes);
+  }
+  // hand out fake, never accessed addresses with 64-bit sizes
+  virtual void * allocAccelBuffer64(uint64_t numBytes) {
+    uint64_t buf = m_nextBuffer;
+    m_nextBuffer += numBytes;
+    m_allocs++;
+    return (void *) buf;
+  }
+  virtual void deallocAccelBuffer(void * buffer) {m_allocs--;}
+  virtual void writeReg(unsigned int regInd, AccelReg regValue) {}
+  virtual AccelReg readReg(unsigned int regInd) {return 0;}
+
+  vector<MockCopy> m_copies;
+  uint64_t m_nextBuffer;
+  int m_allocs;
+
+protected:
+  void recordCopy(void * hostBuffer, void * accelBuffer, unsigned int numBytes) {
+    MockCopy c;
+    c.host = (uint64_t) hostBuffer;
+    c.accel = (uint64_t) accelBuffer;
+    c.numBytes = numBytes;
+    m_copies.push_back(c);
+  }
+};
+
+// a driver without 64-bit allocation support
+class Mock32Driver : public MockDriver {
+public:
+  virtual void * allocAccelBuffer(unsigned int numBytes) {
+    return MockDriver::allocAccelBuffer64(numBytes);
+  }
+  virtual void * allocAccelBuffer64(uint64_t numBytes) {
+    return WrapperRegDriver::allocAccelBuffer64(numBytes);
+  }
+};
+
+unsigned int failures = 0;
+
+string toString(uint64_t n) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%llu", (unsigned long long) n);
+  return string(buf);
+}
+
+void check(bool cond, string what) {
+  cout << (cond ? "PASS " : "FAIL ") << what << endl;
+  if(!cond) failures++;
+}
+
+// the recorded pieces must cover [0, numBytes) in order, each at most
+// 2 GB and 64-byte aligned except for the last one
+bool checkChunks(MockDriver & d, uint64_t host, uint64_t accel, uint64_t numBytes) {
+  uint64_t offs = 0;
+  for(unsigned int i = 0; i < d.m_copies.size(); i++) {
+    MockCopy & c = d.m_copies[i];
+    if(c.host != host + offs || c.accel != accel + offs) return false;
+    if(c.numBytes == 0 || c.numBytes > 2 * GB) return false;
+    if(i + 1 < d.m_copies.size() && c.numBytes % 64 != 0) return false;
+    offs += c.numBytes;
+  }
+  return offs == numBytes;
+}
+
+void testCopies() {
+  // sizes around and across the 4 GB boundary
+  const uint64_t sizes[] = {100, 2 * GB, 4 * GB - 1, 4 * GB, 4 * GB + 1, 9 * GB + 12345};
+  // buffers close below a 4 GB address boundary, so the pieces cross it
+  const uint64_t host = 0x7fff00000000ULL - 64, accel = 0x1ffffffc0ULL;
+  for(unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    MockDriver d;
+    d.copyBufferHostToAccel64((void *) host, (void *) accel, sizes[i]);
+    bool ok = checkChunks(d, host, accel, sizes[i]);
+    d.m_copies.clear();
+    d.copyBufferAccelToHost64((void *) accel, (void *) host, sizes[i]);
+    ok = ok && checkChunks(d, host, accel, sizes[i]);
+    check(ok, "chunked copies of " + toString(sizes[i]) + " bytes");
+  }
+}
+
+void testSizeClasses() {
+  const uint64_t sizes[] = {4 * GB - 1, 4 * GB, 4 * GB + 1, 5 * GB + 3, 17 * GB};
+  for(unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    uint64_t c = AccelBufferPool::sizeClass(sizes[i]);
+    // at most 25% waste, in multiples of 1 GB above 4 GB
+    bool ok = c >= sizes[i] && c - sizes[i] <= sizes[i] / 4;
+    ok = ok && (sizes[i] <= 4 * GB || c % GB == 0);
+    check(ok, "size class of " + toString(sizes[i]) + " bytes is " + toString(c));
+  }
+}
+
+void testPoolAllocs() {
+  MockDriver d;
+  {
+    AccelBufferPool pool(&d);
+    void * a = pool.alloc(5 * GB);
+    void * b = pool.alloc(64);
+    check((uint64_t) b - (uint64_t) a >= 5 * GB, "5 GB pool buffer has its full size");
+    check(pool.getBytesInUse() == AccelBufferPool::sizeClass(5 * GB) + 64, "pool bytes in use above 4 GB");
+    pool.release(a);
+    check(pool.alloc(5 * GB - 100) == a, "released 5 GB buffer is reused");
+  }
+  check(d.m_allocs == 0, "pool frees all buffers");
+
+  Mock32Driver d32;
+  AccelBufferPool pool32(&d32);
+  bool thrown = false;
+  try {
+    pool32.alloc(4 * GB + 1);
+  } catch(const char * e) {
+    thrown = true;
+  }
+  check(thrown, "4 GB + 1 allocation throws without 64-bit platform support");
+  check(pool32.alloc(3 * GB + 1) != 0, "3 GB + 1 allocation works without 64-bit platform support");
+}
+
+// equal-row boundaries must increase from 0 to rows, with partition sizes
+// that differ by at most one row
+void testDivBoundaries() {
+  const unsigned int rows[] = {1, 5, 10, 20, 33, 1000};
+  for(unsigned int i = 0; i < sizeof(rows) / sizeof(rows[0]); i++) {
+    CSC<unsigned int, int64_t> * A = CSC<unsigned int, int64_t>::eye(rows[i]);
+    for(unsigned int p = 1; p <= 16 && p <= rows[i]; p++) {
+      vector<unsigned int> b = A->calcDivBoundaries(p);
+      bool ok = b.size() == p + 1 && b[0] == 0 && b[p] == rows[i];
+      for(unsigned int k = 0; ok && k < p; k++) {
+        unsigned int sz = b[k+1] - b[k];
+        ok = b[k] < b[k+1] && (sz == rows[i] / p || sz == rows[i] / p + 1);
+      }
+      check(ok, "equal-row boundaries for " + toString(rows[i]) + " rows over " + toString(p) + " partitions");
+    }
+    delete A;
+  }
+}
+
+class MinPlusSW : public MinPlusSemiring<unsigned int, int64_t>,
+                  public SWSpMV<unsigned int, int64_t> {
+public:
+  virtual unsigned int statInt(std::string name) {return 0;}
+  virtual std::vector<std::string> statKeys() {return std::vector<std::string>();}
+};
+
+// shortest paths from vertex 0 by min-plus relaxation, y = min(y, A + x).
+// edges 0->1 (2), 1->2 (3), 3->4 (1) and 4->0 (max - 1): vertices 3 and 4
+// are unreachable, so the sums with their infinite distance must stay
+// infinite and not wrap around
+void testMinPlusUnreachable() {
+  const int64_t inf = std::numeric_limits<int64_t>::max();
+  SparseMatrixMetadata * md = new SparseMatrixMetadata;
+  md->rows = 5;
+  md->cols = 5;
+  md->nz = 4;
+  md->startingRow = 0;
+  md->startingCol = 0;
+  md->bytesPerInd = sizeof(unsigned int);
+  md->bytesPerVal = sizeof(int64_t);
+  md->flags = 0;
+  unsigned int * colPtr = new unsigned int[6];
+  unsigned int * rowInd = new unsigned int[4];
+  int64_t * nzData = new int64_t[4];
+  const unsigned int cp[] = {0, 1, 2, 2, 3, 4};
+  const unsigned int ri[] = {1, 2, 4, 0};
+  const int64_t nzd[] = {2, 3, 1, inf - 1};
+  for(unsigned int i = 0; i < 6; i++) colPtr[i] = cp[i];
+  for(unsigned int i = 0; i < 4; i++) {
+    rowInd[i] = ri[i];
+    nzData[i] = nzd[i];
+  }
+  CSC<unsigned int, int64_t> * A = CSC<unsigned int, int64_t>::fromArrays(md,
+    colPtr, rowInd, nzData, true, "minplus");
+  vector<int64_t> dist(5, inf);
+  dist[0] = 0;
+  for(unsigned int step = 0; step < 3; step++) {
+    vector<int64_t> x(dist);
+    MinPlusSW spmv;
+    spmv.setA(A);
+    spmv.setx(&x[0]);
+    spmv.sety(&dist[0]);
+    spmv.exec();
+  }
+  const int64_t expected[] = {0, 2, 5, inf, inf};
+  bool ok = true;
+  for(unsigned int i = 0; i < 5; i++) ok = ok && dist[i] == expected[i];
+  check(ok, "min-plus distances with unreachable vertices");
+  delete A;
+}
+
+int main(int argc, char *argv[])
+{
+  testCopies();
+  testSizeClasses();
+  testPoolAllocs();
+  testDivBoundaries();
+  testMinPlusUnreachable();
+  cout << failures << " failures" << endl;
+  return failures == 0 ? 0 : 1;
+}
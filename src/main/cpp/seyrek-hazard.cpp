@@ -0,0 +1,59 @@
+#include <iostream>
+#include <stdint.h>
+#include "csc.hpp"
+#include "hazardreorder.hpp"
+
+// stand-alone tool for predicting the scheduler hazard stalls of a matrix
+// before and after hazard-aware nonzero reordering. does not need an
+// accelerator, but must be linked together with one of the seyrek-*.cpp
+// files that provide readMatrixData for the platform.
+
+using namespace std;
+
+typedef unsigned int SpMVInd;
+typedef int64_t SpMVVal;
+
+void printPrediction(string title, HazardPrediction p) {
+  cout << title << ": cycles = " << p.cycles;
+  cout << " hazardStallCycles = " << p.hazardStallCycles;
+  cout << " windowStallCycles = " << p.windowStallCycles << endl;
+}
+
+int main(int argc, char *argv[])
+{
+  typedef CSC<SpMVInd, SpMVVal> SparseMatrix;
+
+  try {
+    string matrixName;
+    unsigned int issueWindow, latency, numPartitions;
+    cout << "Enter matrix name: " << endl;
+    cin >> matrixName;
+    cout << "Enter scheduler issue window: " << endl;
+    cin >> issueWindow;
+    cout << "Enter context load-add-save latency (cycles): " << endl;
+    cin >> latency;
+    cout << "Enter number of partitions (PEs): " << endl;
+    cin >> numPartitions;
+
+    SparseMatrix * A = SparseMatrix::load(matrixName);
+    A->printSummary();
+
+    vector<SparseMatrix *> parts = A->partition(numPartitions);
+    HazardReorderer<SpMVInd, SpMVVal> reorderer(issueWindow, latency);
+
+    for(unsigned int p = 0; p < parts.size(); p++) {
+      cout << "Partition " << p << " (" << parts[p]->getNNZ() << " nz)" << endl;
+      printPrediction("  before", reorderer.predict(parts[p]));
+      printPrediction("  after", reorderer.reorder(parts[p]));
+      delete parts[p];
+    }
+
+    delete A;
+
+    return 0;
+
+  } catch(char const * err) {
+    cerr << "Exception: " << err << endl;
+    return 1;
+  }
+}
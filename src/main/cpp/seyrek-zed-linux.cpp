@@ -1,21 +1,25 @@
+// 64-bit file offsets, matrix components can be larger than 4 GB
+#define _FILE_OFFSET_BITS 64
 #include <string>
 #include <stdio.h>
+#include <stdint.h>
 
-void * readMatrixData(std::string name, std::string component) {
+void * readMatrixData(std::string name, std::string component, uint64_t * numBytes) {
   std::string matricesBase = "/root/seyrek/matrices";
   std::string fileName = matricesBase + "/" + name + "/" + name + "-" + component + ".bin";
   FILE *f = fopen(fileName.c_str(), "rb");
   if(!f) throw (std::string("Could not open file: ") + fileName).c_str();
-  fseek(f, 0, SEEK_END);
-  unsigned int fsize = ftell(f);
-  fseek(f, 0, SEEK_SET);
+  fseeko(f, 0, SEEK_END);
+  uint64_t fsize = ftello(f);
+  fseeko(f, 0, SEEK_SET);
 
   void * buf = new char[fsize];
-  unsigned int r = fread(buf, 1, fsize, f);
+  uint64_t r = fread(buf, 1, fsize, f);
 
   if(r != fsize) throw "Read error";
 
   fclose(f);
+  if(numBytes) *numBytes = fsize;
 
   return buf;
 }
@@ -1,20 +1,25 @@
 #include "sdcard.h"
 #include <string>
+#include <stdint.h>
 
 // Seyrek platform function implementations for the ZedBoard
 
 
-void * readMatrixData(std::string name, std::string component) {
+void * readMatrixData(std::string name, std::string component, uint64_t * numBytes) {
   mount();
   std::string matricesBase = "";
   std::string fileName = matricesBase + "/" + name + "/" + name + "-" + component + ".bin";
-  unsigned int fsize = getFileSize(fileName.c_str());
+  uint64_t fsize = getFileSize(fileName.c_str());
 
   if(!fsize) throw "Could not get file size";
+  // the SD card reader and the 32-bit ARM address space limit the files
+  // to below 4 GB, larger matrices must be read on the Linux platform
+  if(fsize > 0xffffffffULL) throw "Matrix files of 4 GB or more not supported on the ZedBoard";
 
-  void * buf = new char[fsize];
-  readFromSDCard(fileName.c_str(), (unsigned int) buf);
+  void * buf = new char[(size_t) fsize];
+  readFromSDCard(fileName.c_str(), (unsigned int) (uintptr_t) buf);
   unmount();
+  if(numBytes) *numBytes = fsize;
 
   return buf;
 }
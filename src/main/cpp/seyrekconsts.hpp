@@ -1,6 +1,8 @@
 #ifndef SEYREKCONSTS_HPP
 #define SEYREKCONSTS_HPP
 
+#include <stdint.h>
+
 // mode settings for Seyrek
 typedef enum {
   START_REGULAR = 0,
@@ -9,4 +11,44 @@ typedef enum {
   START_CONFIG = 3
 } SeyrekModes;
 
+// job descriptor ring layout, must match JobQueueEngine.scala.
+// each 128-byte slot holds a descriptor written by the host, followed by
+// the completion record written by the accelerator.
+
+// modes to run for a job, always in init -> regular -> flush order
+#define SEYREK_JOB_INIT       1
+#define SEYREK_JOB_REGULAR    2
+#define SEYREK_JOB_FLUSH      4
+#define SEYREK_JOB_ALL        7
+
+// number of counters in a completion record, in this order: cycleCount,
+// hazardStallCycles, bypassCount, coalescedMerges, contextCacheHits,
+// contextCacheMisses
+#define SEYREK_JOB_COUNTERS   6
+
+typedef struct {
+  uint64_t colPtr;
+  uint64_t rowInd;
+  uint64_t nzData;
+  uint64_t inpVec;
+  uint64_t outVec;
+  uint32_t rows;
+  uint32_t cols;
+  uint32_t nz;
+  uint32_t modes;
+  uint64_t semiringSel;
+} SpMVJobDescriptor;
+
+typedef struct {
+  uint32_t jobNum;
+  uint32_t done;
+  uint64_t counters[SEYREK_JOB_COUNTERS];
+  uint64_t reserved;
+} SpMVJobCompletion;
+
+typedef struct {
+  SpMVJobDescriptor desc;
+  SpMVJobCompletion completion;
+} SpMVJobSlot;
+
 #endif // SEYREKCONSTS_HPP
@@ -24,7 +24,9 @@ public:
     for(SpMVInd col = 0; col < cols; col++) {
       for(SpMVInd ep = colPtr[col]; ep < colPtr[col+1]; ep++) {
         SpMVInd rowInd = rowInds[ep];
-        SpMVVal mulRes = this->mul(nzData[ep], m_x[col], rowInd, col);
+        // pattern-only matrices have an implicit value of one
+        SpMVVal matVal = nzData ? nzData[ep] : this->one();
+        SpMVVal mulRes = this->mul(matVal, m_x[col], rowInd, col);
         SpMVVal addRes = this->add(m_y[rowInd], mulRes, rowInd, col);
         m_y[rowInd] = addRes;
       }
@@ -0,0 +1,50 @@
+#ifndef SWDCSCSPMV_HPP
+#define SWDCSCSPMV_HPP
+
+#include "cscspmv.hpp"
+#include "dcsc.hpp"
+
+// implements the exec() for software-based SpMV-over-semirings on
+// DCSC-encoded (hypersparse) matrices. x and y are indexed with the
+// original column and (partition-local) row indices.
+// add() and mul() must be implemented in the derived class
+
+template <class SpMVInd, class SpMVVal>
+class SWDCSCSpMV : public virtual CSCSpMV<SpMVInd, SpMVVal> {
+protected:
+  using CSCSpMV<SpMVInd, SpMVVal>::m_y;
+  using CSCSpMV<SpMVInd, SpMVVal>::m_x;
+  DCSC<SpMVInd, SpMVVal> * m_dA;
+
+public:
+  SWDCSCSpMV() {m_dA = 0;}
+  virtual ~SWDCSCSpMV() {};
+
+  virtual void setA(CSC<SpMVInd, SpMVVal> * A) {
+    m_dA = dynamic_cast<DCSC<SpMVInd, SpMVVal> *>(A);
+    if(!m_dA) throw "SWDCSCSpMV needs a DCSC matrix";
+    CSCSpMV<SpMVInd, SpMVVal>::setA(A);
+  }
+
+  virtual bool exec() {
+    unsigned int nzCols = m_dA->getNZCols();
+    SpMVInd * colInds = m_dA->getColInds();
+    SpMVInd * colPtr = m_dA->getIndPtrs();
+    SpMVInd * rowInds = m_dA->getInds();
+    SpMVVal * nzData = m_dA->getNZData();
+    for(SpMVInd c = 0; c < nzCols; c++) {
+      SpMVInd col = colInds[c];
+      for(SpMVInd ep = colPtr[c]; ep < colPtr[c+1]; ep++) {
+        SpMVInd rowInd = rowInds[ep];
+        // pattern-only matrices have an implicit value of one
+        SpMVVal matVal = nzData ? nzData[ep] : this->one();
+        SpMVVal mulRes = this->mul(matVal, m_x[col], rowInd, col);
+        SpMVVal addRes = this->add(m_y[rowInd], mulRes, rowInd, col);
+        m_y[rowInd] = addRes;
+      }
+    }
+    return true;
+  }
+};
+
+#endif // SWDCSCSPMV_HPP
@@ -0,0 +1,98 @@
+#ifndef SWSYMCSCSPMV_HPP
+#define SWSYMCSCSPMV_HPP
+
+#include <vector>
+#include "cscspmv.hpp"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// implements the exec() for software-based SpMV-over-semirings on symmetric
+// matrices that store only the lower triangle (see CSC::lowerTriangle).
+// each stored off-diagonal nonzero A(row, col) is applied to both y[row]
+// and, as A(col, row), to y[col], so the matrix is streamed only once.
+// when built with OpenMP, the columns are split between threads. since the
+// transposed updates of a thread can hit any row of y, each thread
+// accumulates into a private copy of y (starting from the semiring zero),
+// and the copies are added into y at the end.
+// add() and mul() must be implemented in the derived class
+
+template <class SpMVInd, class SpMVVal>
+class SWSymSpMV : public virtual CSCSpMV<SpMVInd, SpMVVal> {
+protected:
+  using CSCSpMV<SpMVInd, SpMVVal>::m_A;
+  using CSCSpMV<SpMVInd, SpMVVal>::m_y;
+  using CSCSpMV<SpMVInd, SpMVVal>::m_x;
+  unsigned int m_numThreads;
+
+public:
+  SWSymSpMV() {m_numThreads = 1;}
+  virtual ~SWSymSpMV() {};
+
+  virtual void setA(CSC<SpMVInd, SpMVVal> * A) {
+    if(!A->isSymmetric()) throw "SWSymSpMV needs a symmetric matrix";
+    CSCSpMV<SpMVInd, SpMVVal>::setA(A);
+  }
+
+  // number of threads to use, only has an effect when built with OpenMP
+  void setNumThreads(unsigned int numThreads) {
+    if(numThreads == 0) throw "numThreads must be nonzero in SWSymSpMV";
+    m_numThreads = numThreads;
+  }
+
+  virtual bool exec() {
+    unsigned int cols = m_A->getCols();
+    if(m_numThreads == 1) {
+      applyCols(0, cols, m_y);
+      return true;
+    }
+    unsigned int rows = m_A->getRows();
+    std::vector<std::vector<SpMVVal> > privY(m_numThreads);
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(m_numThreads) schedule(static, 1)
+#endif
+    for(int t = 0; t < (int) m_numThreads; t++) {
+      privY[t].assign(rows, this->zero());
+      // interleave the columns in chunks, so that threads get similar work
+      // even though the lower-triangle columns get shorter towards the end
+      for(unsigned int c = t * SYMSPMV_CHUNK; c < cols; c += m_numThreads * SYMSPMV_CHUNK) {
+        unsigned int end = c + SYMSPMV_CHUNK < cols ? c + SYMSPMV_CHUNK : cols;
+        applyCols(c, end, &privY[t][0]);
+      }
+    }
+    // reduce the private copies into y, split over the rows
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(m_numThreads)
+#endif
+    for(int row = 0; row < (int) rows; row++) {
+      for(unsigned int t = 0; t < m_numThreads; t++)
+        m_y[row] = this->add(m_y[row], privY[t][row], row, 0);
+    }
+    return true;
+  }
+
+protected:
+  enum { SYMSPMV_CHUNK = 256 };
+
+  // apply the nonzeros of columns [colStart, colEnd) to y
+  void applyCols(SpMVInd colStart, SpMVInd colEnd, SpMVVal * y) {
+    SpMVInd * colPtr = m_A->getIndPtrs();
+    SpMVInd * rowInds = m_A->getInds();
+    SpMVVal * nzData = m_A->getNZData();
+    for(SpMVInd col = colStart; col < colEnd; col++) {
+      for(SpMVInd ep = colPtr[col]; ep < colPtr[col+1]; ep++) {
+        SpMVInd rowInd = rowInds[ep];
+        // pattern-only matrices have an implicit value of one
+        SpMVVal matVal = nzData ? nzData[ep] : this->one();
+        SpMVVal mulRes = this->mul(matVal, m_x[col], rowInd, col);
+        y[rowInd] = this->add(y[rowInd], mulRes, rowInd, col);
+        if(rowInd != col) {
+          mulRes = this->mul(matVal, m_x[rowInd], col, rowInd);
+          y[col] = this->add(y[col], mulRes, col, rowInd);
+        }
+      }
+    }
+  }
+};
+
+#endif // SWSYMCSCSPMV_HPP
@@ -17,6 +17,30 @@ public:
   virtual void * allocAccelBuffer(unsigned int numBytes) {return 0;}
   virtual void deallocAccelBuffer(void * buffer) {}
 
+  // 64-bit variants of the buffer functions. by default, copies are split
+  // into pieces the 32-bit functions can handle, while allocations above
+  // 4 GB need a platform that overrides allocAccelBuffer64.
+  virtual void copyBufferHostToAccel64(void * hostBuffer, void * accelBuffer, uint64_t numBytes) {
+    uint64_t offs = 0;
+    while(offs < numBytes) {
+      unsigned int chunk = copyChunkSize(numBytes - offs);
+      copyBufferHostToAccel((char *) hostBuffer + offs, (char *) accelBuffer + offs, chunk);
+      offs += chunk;
+    }
+  }
+  virtual void copyBufferAccelToHost64(void * accelBuffer, void * hostBuffer, uint64_t numBytes) {
+    uint64_t offs = 0;
+    while(offs < numBytes) {
+      unsigned int chunk = copyChunkSize(numBytes - offs);
+      copyBufferAccelToHost((char *) accelBuffer + offs, (char *) hostBuffer + offs, chunk);
+      offs += chunk;
+    }
+  }
+  virtual void * allocAccelBuffer64(uint64_t numBytes) {
+    if(numBytes > 0xffffffffULL) throw "Accel buffers above 4 GB not supported by this platform";
+    return allocAccelBuffer((unsigned int) numBytes);
+  }
+
   // (optional) functions for accelerator attach-detach handling
   virtual void attach(const char * name) {}
   virtual void detach() {}
@@ -25,6 +49,12 @@ public:
   virtual void writeReg(unsigned int regInd, AccelReg regValue) = 0;
   virtual AccelReg readReg(unsigned int regInd) = 0;
 
+protected:
+  // largest piece for the 32-bit copy functions, kept 64-byte aligned
+  static unsigned int copyChunkSize(uint64_t remaining) {
+    const uint64_t maxChunk = 0x80000000ULL;
+    return (unsigned int) (remaining < maxChunk ? remaining : maxChunk);
+  }
 };
 
 #endif // WRAPPERREGDRIVER_H
@@ -25,6 +25,8 @@ trait SeyrekParams {
   // scheduler-related
   def issueWindow: Int
   def makeScheduler: () => Scheduler
+  // number of same-row coalescing stages before the scheduler (0 = none)
+  val coalesceStages: Int = 0
   // type definitions for convenience, useful as clone types
   def v = UInt(width = valWidth)  // values
   def i = UInt(width = indWidth)  // index (context identifier / row index)
@@ -33,6 +35,27 @@ trait SeyrekParams {
   def vv = new BinaryMathOperands(valWidth) // (value, value)
   // channel-to-port mapping
    def chanConfig: Map[String, ReadChanParams]
+  // pattern-only matrices: the nzdata stream is not read (and needs no
+  // channel), every matrix value is the semiring one instead
+  val patternOnly: Boolean = false
+  val semiringOne: BigInt = 1
+  // runtime-selectable semiring: makeSemiringAdd/Mul are not used, the ops
+  // are picked from SemiringOps by the semiringSel register instead
+  val selectableSemiring: Boolean = false
+  // number of frontend lanes. with more than one lane, the backend delivers
+  // up to frontendLanes work units per cycle, each lane has its own
+  // multiplier, and the products are routed to per-bank schedulers, adders
+  // and context memory banks (row r goes to bank r % frontendLanes).
+  // must be a power of two, and the packed rowind and nzdata streams of
+  // all lanes must fit into one memory beat
+  val frontendLanes: Int = 1
+  // whether each PE has a JobQueueEngine, for running batches of jobs from
+  // a descriptor ring in memory
+  val jobQueue: Boolean = false
+  // context memory for multi-lane frontends
+  def makeBankedContextMemory: ReadChanParams => BankedContextMem = {
+    r => throw new Exception("No banked context memory for " + accelName)
+  }
 }
 
 class WorkUnit(valWidth: Int, indWidth: Int) extends Bundle {
@@ -75,12 +98,14 @@ object ValIndPair {
 class ContextfulSemiringOpIO(p: SeyrekParams) extends Bundle {
   val in = Decoupled(p.wu).flip
   val out = Decoupled(p.vi)
+  // op selection, only used with selectable semirings
+  val sel = UInt(INPUT, width = SemiringOps.opSelWidth)
 }
 
-class ContextfulSemiringOp(p: SeyrekParams, instFxn: () => BinaryMathOp)
-extends Module {
+class ContextfulSemiringOp(p: SeyrekParams, instFxn: () => BinaryMathOp,
+  selFxns: Seq[(UInt, UInt) => UInt] = Seq()) extends Module {
   val io = new ContextfulSemiringOpIO(p)
-  val opInst = Module(instFxn())
+  val opInst = SemiringOp(p, instFxn, selFxns, io.sel)
   val forker = Module(new StreamFork(genIn = p.wu, genA = p.vv, genB = p.i,
     forkA = {wu: WorkUnit => BinaryMathOperands(wu.matrixVal, wu.vectorVal)},
     forkB = {wu: WorkUnit => wu.rowInd}
@@ -90,8 +115,8 @@ extends Module {
   )).io
 
   io.in <> forker.in
-  forker.outA <> opInst.io.in
-  opInst.io.out <> joiner.inA
+  forker.outA <> opInst.in
+  opInst.out <> joiner.inA
   joiner.out <> io.out
 
 
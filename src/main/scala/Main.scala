@@ -52,6 +52,8 @@ object ChannelConfigs {
     "ctxmem-r" -> ReadChanParams(maxReadTxns = 8, port = 0),
     "ctxmem-w" -> ReadChanParams(maxReadTxns = 8, port = 0)
   )
+  // for pattern-only configs, which do not read nzdata
+  val onePortPattern = onePort - "nzdata"
 }
 
 class UInt32BRAMSpMVParams(p: PlatformWrapperParams) extends SeyrekParams {
@@ -80,6 +82,23 @@ class UInt32BRAMSpMVParams(p: PlatformWrapperParams) extends SeyrekParams {
   val makeScheduler = { () => new InOrderScheduler(this) }
 }
 
+// pattern-only variant over the boolean (OR, AND) semiring, e.g. for BFS:
+// the nzdata stream is skipped, halving the matrix bytes to fetch
+class UInt32BRAMPatternSpMVParams(p: PlatformWrapperParams)
+extends UInt32BRAMSpMVParams(p) {
+  override val accelName = "UInt32BRAMPattern"
+  override val chanConfig = ChannelConfigs.onePortPattern
+  override val patternOnly = true
+
+  override val makeSemiringAdd = { () =>
+    new StagedUIntOp(valWidth, 1, {(a: UInt, b: UInt) => a | b})
+  }
+
+  override val makeSemiringMul = { () =>
+    new StagedUIntOp(valWidth, 1, {(a: UInt, b: UInt) => a & b})
+  }
+}
+
 class UInt64BRAMSpMVParams(p: PlatformWrapperParams) extends SeyrekParams {
   val accelName = "UInt64BRAM"
   val numPEs = 1
@@ -132,6 +151,105 @@ class UInt64ExtSpMVParams(p: PlatformWrapperParams) extends SeyrekParams {
   val makeScheduler = { () => new OoOComplScheduler(this) }
 }
 
+class UInt64CachedSpMVParams(p: PlatformWrapperParams) extends SeyrekParams {
+  val accelName = "UInt64Cached"
+  val numPEs = 1
+  val portsPerPE = 4
+  val chanConfig = ChannelConfigs.fourPort
+  val indWidth = 32
+  val valWidth = 64
+  val mrp = p.toMemReqParams()
+  val makeContextMemory = { r: ReadChanParams =>
+    new CachedContextMem(new CachedContextMemParams(
+      lines = 4096, chanID = r.chanBaseID,
+      idBits = indWidth, dataBits = valWidth, mrp = p.toMemReqParams()
+    ))
+  }
+
+  val makeSemiringAdd = { () =>
+    new StagedUIntOp(valWidth, 1, {(a: UInt, b: UInt) => a+b})
+  }
+
+  val makeSemiringMul = { () =>
+    new SystolicSInt64Mul_5Stage()
+  }
+  val issueWindow = 16
+  val makeScheduler = { () => new InOrderScheduler(this) }
+}
+
+// UInt64BRAM with several PEs, the PEs share the platform memory ports
+class UInt64BRAMMultiPESpMVParams(p: PlatformWrapperParams, n: Int)
+extends UInt64BRAMSpMVParams(p) {
+  override val accelName = "UInt64BRAMx" + n
+  override val numPEs = n
+}
+
+// UInt64BRAM with a runtime-selectable semiring unit, so that e.g. BFS,
+// SSSP and PageRank can run back to back without reconfiguration
+class UInt64BRAMSelectableSpMVParams(p: PlatformWrapperParams)
+extends UInt64BRAMSpMVParams(p) {
+  override val accelName = "UInt64BRAMSelectable"
+  override val selectableSemiring = true
+}
+
+// two-lane version of UInt32BRAM: with 32-bit values and indices, the
+// nzdata and rowind beats carry two nonzeros each, which the frontend can
+// process in parallel with a banked (2 x 1024 rows) context memory
+class UInt32BRAMWideSpMVParams(p: PlatformWrapperParams) extends SeyrekParams {
+  val accelName = "UInt32BRAMWide"
+  val numPEs = 1
+  val portsPerPE = 4
+  val chanConfig = ChannelConfigs.fourPortBRAM
+  val indWidth = 32
+  val valWidth = 32
+  val mrp = p.toMemReqParams()
+  override val frontendLanes = 2
+  val makeContextMemory = { r: ReadChanParams =>
+    new BRAMContextMem(new BRAMContextMemParams(
+      depth = 1024, readLatency = 1, writeLatency = 1, chanID = r.chanBaseID ,
+      idBits = indWidth, dataBits = valWidth, mrp = p.toMemReqParams()
+    ))
+  }
+  override def makeBankedContextMemory = { r: ReadChanParams =>
+    new BankedBRAMContextMem(new BRAMContextMemParams(
+      depth = 1024, readLatency = 1, writeLatency = 1, chanID = r.chanBaseID ,
+      idBits = indWidth, dataBits = valWidth, mrp = p.toMemReqParams()
+    ), frontendLanes)
+  }
+
+  val makeSemiringAdd = { () =>
+    new StagedUIntOp(valWidth, 1, {(a: UInt, b: UInt) => a+b})
+  }
+
+  val makeSemiringMul = { () =>
+    new StagedUIntOp(valWidth, 1, {(a: UInt, b: UInt) => a*b})
+  }
+  val issueWindow = 4
+  val makeScheduler = { () => new InOrderScheduler(this) }
+}
+
+// UInt64BRAM with descriptor-based job submission
+class UInt64BRAMJobsSpMVParams(p: PlatformWrapperParams)
+extends UInt64BRAMSpMVParams(p) {
+  override val accelName = "UInt64BRAMJobs"
+  override val jobQueue = true
+}
+
+// same as UInt64BRAM, with two same-row coalescing stages in the frontend
+class UInt64BRAMCoalesceSpMVParams(p: PlatformWrapperParams)
+extends UInt64BRAMSpMVParams(p) {
+  override val accelName = "UInt64BRAMCoalesce"
+  override val coalesceStages = 2
+}
+
+// same as UInt64Ext, but with out-of-order dispatch so that a hazarding
+// row does not block the independent instructions behind it
+class UInt64ExtOoODSpMVParams(p: PlatformWrapperParams)
+extends UInt64ExtSpMVParams(p) {
+  override val accelName = "UInt64ExtOoOD"
+  override val makeScheduler = { () => new OoODispatchScheduler(this) }
+}
+
 object SeyrekMainObj {
   type AccelInstFxn = PlatformWrapperParams => SpMVAccel
   type AccelMap = Map[String, AccelInstFxn]
@@ -140,8 +258,18 @@ object SeyrekMainObj {
 
   val accelMap: AccelMap  = Map(
     "UInt32BRAM" -> {p => new SpMVAccel(p, new UInt32BRAMSpMVParams(p))},
+    "UInt32BRAMPattern" -> {p => new SpMVAccel(p, new UInt32BRAMPatternSpMVParams(p))},
     "UInt64Ext" -> {p => new SpMVAccel(p, new UInt64ExtSpMVParams(p))},
-    "UInt64BRAM" -> {p => new SpMVAccel(p, new UInt64BRAMSpMVParams(p))}
+    "UInt64ExtOoOD" -> {p => new SpMVAccel(p, new UInt64ExtOoODSpMVParams(p))},
+    "UInt64BRAM" -> {p => new SpMVAccel(p, new UInt64BRAMSpMVParams(p))},
+    "UInt64BRAMx2" -> {p => new SpMVAccel(p, new UInt64BRAMMultiPESpMVParams(p, 2))},
+    "UInt64BRAMx4" -> {p => new SpMVAccel(p, new UInt64BRAMMultiPESpMVParams(p, 4))},
+    "UInt64BRAMx8" -> {p => new SpMVAccel(p, new UInt64BRAMMultiPESpMVParams(p, 8))},
+    "UInt64BRAMSelectable" -> {p => new SpMVAccel(p, new UInt64BRAMSelectableSpMVParams(p))},
+    "UInt32BRAMWide" -> {p => new SpMVAccel(p, new UInt32BRAMWideSpMVParams(p))},
+    "UInt64BRAMJobs" -> {p => new SpMVAccel(p, new UInt64BRAMJobsSpMVParams(p))},
+    "UInt64BRAMCoalesce" -> {p => new SpMVAccel(p, new UInt64BRAMCoalesceSpMVParams(p))},
+    "UInt64Cached" -> {p => new SpMVAccel(p, new UInt64CachedSpMVParams(p))}
   )
 
   val platformMap: PlatformMap = Map(
@@ -189,7 +317,11 @@ object SeyrekMainObj {
     val seyrekFiles = Array("commonsemirings.hpp", "hwcscspmv.hpp",
       "semiring.hpp", "wrapperregdriver.h", "csc.hpp", "main.cpp",
       "cscspmv.hpp", "platform.h", "swcscspmv.hpp", "seyrek-tester.cpp",
-      "seyrekconsts.hpp", "parallelspmv.hpp")
+      "seyrek-hazard.cpp",
+      "seyrekconsts.hpp", "parallelspmv.hpp", "hazardreorder.hpp",
+      "dcsc.hpp", "swdcscspmv.hpp", "accelbufferpool.hpp", "hostarena.hpp",
+      "partitioncache.hpp", "jobqueue.hpp", "cscdelta.hpp",
+      "swsymcscspmv.hpp", "autotuner.hpp")
     for(f <- seyrekFiles) { fileCopy(seyrekDrvRoot + f, "emulator/" + f) }
   }
 
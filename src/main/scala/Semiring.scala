@@ -18,6 +18,105 @@ class OpMulCombinatorial(w: Int) extends BinaryMathOp(w) {
   val latency = 0
 }
 
+// op codes for the runtime-selectable semiring unit, as written into the
+// semiringSel register: add op in bits 3..0, mul op in bits 7..4.
+// must match SemiringAddOp and SemiringMulOp in semiring.hpp
+object SemiringOps {
+  val selWidth = 8
+  val opSelWidth = 4
+
+  // plus, min, max, or
+  val addFxns = Seq[(UInt, UInt) => UInt](
+    {(a, b) => a + b},
+    {(a, b) => Mux(a.toSInt < b.toSInt, a, b)},
+    {(a, b) => Mux(a.toSInt > b.toSInt, a, b)},
+    {(a, b) => boolVal(a, a.orR || b.orR)}
+  )
+  // times, plus, and
+  val mulFxns = Seq[(UInt, UInt) => UInt](
+    {(a, b) => a * b},
+    {(a, b) => satPlus(a, b)},
+    {(a, b) => boolVal(a, a.orR && b.orR)}
+  )
+  // identity of each mul op, as Semiring::one() in commonsemirings.hpp
+  val mulOnes = Seq[BigInt](1, 0, 1)
+
+  // signed add that saturates at the largest value, which min-plus uses
+  // as its zero (unreachable): inf + b, a + inf and overflows give inf.
+  // must match MinPlusSemiring::mul in commonsemirings.hpp
+  def satPlus(a: UInt, b: UInt): UInt = {
+    val w = a.getWidth()
+    val inf = UInt((BigInt(1) << (w-1)) - 1, width = w)
+    val sum = (a + b)(w-1, 0)
+    val overflow = !a(w-1) && !b(w-1) && sum(w-1)
+    Mux(a === inf || b === inf || overflow, inf, sum)
+  }
+
+  // or and and are logical, any nonzero value is true and the result is 0
+  // or 1 in the width of a, like BoolOrAndSemiring in commonsemirings.hpp
+  def boolVal(a: UInt, b: Bool): UInt = Cat(UInt(0, width = a.getWidth()-1), b)
+
+  def addSel(sel: UInt): UInt = sel(3, 0)
+  def mulSel(sel: UInt): UInt = sel(7, 4)
+
+  // identity of the selected mul op, unknown op codes act like op 0
+  def mulOne(w: Int, mulSel: UInt): UInt = {
+    val ones = mulOnes.map(o => UInt(o, width = w))
+    Vec(ones ++ Seq.fill((1 << opSelWidth) - ones.size)(ones(0)))(mulSel)
+  }
+}
+
+// semiring op whose function is picked at runtime among fxns by sel.
+// all functions are evaluated on the operands, and the selected result
+// enters an n-stage delay pipe, like in StagedUIntOp. sel values without a
+// function (unknown op codes) select the first one.
+class SelectableSemiringOp(w: Int, n: Int, fxns: Seq[(UInt, UInt) => UInt])
+extends Module {
+  val io = new Bundle {
+    val in = Decoupled(new BinaryMathOperands(w)).flip
+    val out = Decoupled(UInt(width = w))
+    val sel = UInt(INPUT, width = SemiringOps.opSelWidth)
+  }
+  val latency = n
+  if(latency == 0) {
+    println("SelectableSemiringOp needs at least 1 stage")
+    System.exit(-1)
+  }
+  if(fxns.size > (1 << SemiringOps.opSelWidth))
+    throw new Exception("Too many functions for SelectableSemiringOp")
+  val fxnResults = fxns.map(f => f(io.in.bits.first, io.in.bits.second)(w-1, 0))
+  val results = Vec(fxnResults ++
+    Seq.fill((1 << SemiringOps.opSelWidth) - fxns.size)(fxnResults(0)))
+  val delayPipe = Vec.fill(n) {SystolicReg(w)}
+  delayPipe(0).in.valid := io.in.valid
+  delayPipe(0).in.bits := results(io.sel)
+  io.in.ready := delayPipe(0).in.ready
+  for(i <- 0 until n-1) {
+    delayPipe(i+1).in <> delayPipe(i).out
+  }
+  io.out <> delayPipe(n-1).out
+}
+
+// ports of an instantiated semiring op
+class SemiringOpPorts(val in: DecoupledIO[BinaryMathOperands],
+  val out: DecoupledIO[UInt], val latency: Int)
+
+// instantiate one op of the semiring of p: the fixed op from instFxn, or a
+// selectable op over selFxns (controlled by sel) for selectable semirings
+object SemiringOp {
+  def apply(p: SeyrekParams, instFxn: () => BinaryMathOp,
+    selFxns: Seq[(UInt, UInt) => UInt], sel: UInt): SemiringOpPorts = {
+    if(p.selectableSemiring) {
+      val op = Module(new SelectableSemiringOp(p.valWidth, 1, selFxns))
+      op.io.sel := sel
+      new SemiringOpPorts(op.io.in, op.io.out, op.latency)
+    } else {
+      val op = Module(instFxn())
+      new SemiringOpPorts(op.io.in, op.io.out, op.latency)
+    }
+  }
+}
+
 // generate operator (defined by fxn) with n-cycle latency
 // mostly intended to simulate high-latency ops, won't make much sense
 // in synthesis since all "useful work" is carried out before entering
@@ -5,8 +5,7 @@ import TidbitsDMA._
 import TidbitsOCM._
 import TidbitsStreams._
 
-// TODO make init range and value customizable
-// TODO make flush range customizable
+// TODO make init range customizable
 
 class BRAMContextMemParams(
   val depth: Int,
@@ -46,7 +45,7 @@ class BRAMContextMem(p: BRAMContextMemParams) extends ContextMem(p) {
   genInit.step := UInt(1)
   genInit.seq.ready := initReqQ.enq.ready
   initReqQ.enq.valid := genInit.seq.valid
-  initReqQ.enq.bits.value := UInt(0)
+  initReqQ.enq.bits.value := io.contextInit
   initReqQ.enq.bits.ind := genInit.seq.bits
   // reducer for init completion detection
   val finInit = Module(new StreamReducer(p.dataBits, 0, {_+_})).io
@@ -66,10 +65,12 @@ class BRAMContextMem(p: BRAMContextMemParams) extends ContextMem(p) {
   DecoupledInputMux(loadSel, loadReqs) <> bramw.contextLoadReq
   bramw.contextLoadRsp <> DecoupledOutputDemux(loadSel, loadRsps)
   // sequence generator for flush addresses
+  // only the rows of the output vector are flushed (rounded up to a beat)
+  val flushCount = ContextMem.flushCount(p, io.contextRows)
   val genFlush = Module(new SequenceGenerator(addrBits)).io
   genFlush.start := Bool(false)
   genFlush.init := UInt(0)
-  genFlush.count := UInt(p.depth)
+  genFlush.count := flushCount
   genFlush.step := UInt(1)
   genFlush.seq.ready := flushReqQ.enq.ready
   flushReqQ.enq.valid := genFlush.seq.valid
@@ -81,7 +82,7 @@ class BRAMContextMem(p: BRAMContextMemParams) extends ContextMem(p) {
   ))).io
   flush.start := Bool(false)
   flush.baseAddr := io.contextBase
-  flush.byteCount := UInt(p.depth * p.dataBits/8)
+  flush.byteCount := flushCount * UInt(p.dataBits/8)
   flush.in.valid := flushRspQ.deq.valid
   flush.in.bits := flushRspQ.deq.bits.matrixVal
   flushRspQ.deq.ready := flush.in.ready
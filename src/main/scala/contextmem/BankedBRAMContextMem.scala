@@ -0,0 +1,124 @@
+package Seyrek
+
+import Chisel._
+import TidbitsDMA._
+import TidbitsOCM._
+import TidbitsStreams._
+
+// BRAM context memory with <banks> interleaved banks of p.depth entries,
+// for frontends with several lanes. like BRAMContextMem, init writes
+// contextInit into all entries, and flush writes out the rows of the output
+// vector (rounded up to a memory beat). flush goes in global row order, so
+// the output vector layout is the same as for an unbanked memory.
+
+class BankedBRAMContextMem(p: BRAMContextMemParams, banks: Int)
+extends BankedContextMem(p, banks) {
+  val bankBits = log2Up(banks)
+  val addrBits = log2Up(p.depth)
+
+  io.finished := Bool(false)
+  io.mainMem.memRdReq.valid := Bool(false)
+  io.mainMem.memRdRsp.ready := Bool(false)
+
+  val sActive :: sInit :: sFlush :: sFinished :: Nil = Enum(UInt(), 4)
+  val regState = Reg(init = UInt(sActive))
+  val initing = (regState === sInit)
+  val flushing = (regState === sFlush)
+
+  // conversion between global row indices and bank-local indices
+  def localInd(ind: UInt): UInt = ind >> UInt(bankBits)
+  def globalInd(ind: UInt, bank: Int): UInt =
+    Cat(ind(p.idBits-bankBits-1, 0), UInt(bank, width = bankBits))
+
+  val bramw = (0 until banks).map(b => Module(new BRAMWrapper(p)).io)
+
+  // init: write contextInit to the same local index in all banks at once
+  val regInitInd = Reg(init = UInt(0, addrBits+1))
+  val regInitRsps = Reg(init = UInt(0, addrBits+1))
+  val allSaveReady = bramw.map(m => m.contextSaveReq.ready).reduce(_ & _)
+  val initIssue = initing & (regInitInd < UInt(p.depth)) & allSaveReady
+  when(initIssue) { regInitInd := regInitInd + UInt(1) }
+  // all banks see the same sequence, so counting one bank is enough
+  when(initing & bramw(0).contextSaveRsp.valid) {
+    regInitRsps := regInitRsps + UInt(1)
+  }
+
+  // flush: read the entries for the rows in global order, the order queue
+  // remembers which bank each response has to be taken from
+  val flushCount = ContextMem.flushCount(p, io.contextRows)
+  val regFlushInd = Reg(init = UInt(0, addrBits+bankBits+1))
+  val flushBank = regFlushInd(bankBits-1, 0)
+  val orderQ = Module(new FPGAQueue(UInt(width = bankBits),
+    banks * (p.readLatency + 2))).io
+  val loadReady = Vec(bramw.map(m => m.contextLoadReq.ready))
+  val flushIssue = flushing & (regFlushInd < flushCount) &
+    orderQ.enq.ready & loadReady(flushBank)
+  orderQ.enq.valid := flushIssue
+  orderQ.enq.bits := flushBank
+  when(flushIssue) { regFlushInd := regFlushInd + UInt(1) }
+
+  val flush = Module(new StreamWriter(new StreamWriterParams(
+    streamWidth = p.dataBits, mem = p.mrp, chanID = p.chanID
+  ))).io
+  flush.start := flushing
+  flush.baseAddr := io.contextBase
+  flush.byteCount := flushCount * UInt(p.dataBits/8)
+  val headBank = orderQ.deq.bits
+  val loadRspValid = Vec(bramw.map(m => m.contextLoadRsp.valid))
+  val loadRspData = Vec(bramw.map(m => m.contextLoadRsp.bits.matrixVal))
+  flush.in.valid := flushing & orderQ.deq.valid & loadRspValid(headBank)
+  flush.in.bits := loadRspData(headBank)
+  orderQ.deq.ready := flushing & flush.in.valid & flush.in.ready
+  flush.req <> io.mainMem.memWrReq
+  flush.wdat <> io.mainMem.memWrDat
+  io.mainMem.memWrRsp <> flush.rsp
+
+  for(b <- 0 until banks) {
+    val m = bramw(b)
+    // save port: regular saves, or contextInit during init
+    m.contextSaveReq.valid := Mux(initing, initIssue, io.contextSaveReq(b).valid)
+    m.contextSaveReq.bits.value := Mux(initing, io.contextInit, io.contextSaveReq(b).bits.value)
+    m.contextSaveReq.bits.ind := Mux(initing, regInitInd, localInd(io.contextSaveReq(b).bits.ind))
+    io.contextSaveReq(b).ready := !initing & m.contextSaveReq.ready
+    io.contextSaveRsp(b).valid := !initing & m.contextSaveRsp.valid
+    io.contextSaveRsp(b).bits := globalInd(m.contextSaveRsp.bits, b)
+    m.contextSaveRsp.ready := initing | io.contextSaveRsp(b).ready
+
+    // load port: regular loads, or reads for the flush
+    val flushThis = flushIssue & (flushBank === UInt(b))
+    m.contextLoadReq.valid := Mux(flushing, flushThis, io.contextLoadReq(b).valid)
+    m.contextLoadReq.bits.value := Mux(flushing, UInt(0), io.contextLoadReq(b).bits.value)
+    m.contextLoadReq.bits.ind := Mux(flushing, localInd(regFlushInd), localInd(io.contextLoadReq(b).bits.ind))
+    io.contextLoadReq(b).ready := !flushing & m.contextLoadReq.ready
+    io.contextLoadRsp(b).valid := !flushing & m.contextLoadRsp.valid
+    io.contextLoadRsp(b).bits := m.contextLoadRsp.bits
+    io.contextLoadRsp(b).bits.rowInd := globalInd(m.contextLoadRsp.bits.rowInd, b)
+    m.contextLoadRsp.ready := Mux(flushing,
+      orderQ.deq.ready & (headBank === UInt(b)), io.contextLoadRsp(b).ready)
+  }
+
+  switch(regState) {
+    is(sActive) {
+      regInitInd := UInt(0)
+      regInitRsps := UInt(0)
+      regFlushInd := UInt(0)
+      when (io.start) {
+        when (io.mode === SeyrekModes.START_INIT) {regState := sInit}
+        .elsewhen (io.mode === SeyrekModes.START_FLUSH) {regState := sFlush}
+      }
+    }
+
+    is(sInit) {
+      when (regInitRsps === UInt(p.depth)) { regState := sFinished }
+    }
+
+    is(sFlush) {
+      when (flush.finished) { regState := sFinished }
+    }
+
+    is(sFinished) {
+      io.finished := Bool(true)
+      when (!io.start) {regState := sActive}
+    }
+  }
+}
@@ -0,0 +1,264 @@
+package Seyrek
+
+import Chisel._
+import TidbitsDMA._
+import TidbitsOCM._
+
+class CachedContextMemParams(
+  val lines: Int,   // number of cache lines (power of two), one context each
+  idBits: Int,
+  dataBits: Int,
+  chanID: Int,
+  mrp: MemReqParams
+) extends ContextMemParams(idBits, dataBits, chanID, mrp)
+
+// context memory in external memory, with a direct-mapped write-back cache
+// of p.lines contexts in front of it. meant for row counts too large for
+// BRAMContextMem, where a hot subset of rows still fits on-chip.
+// - the lines are kept in a dual-port BRAM. lookups are pipelined: loads
+//   that hit, and saves that do not evict a dirty line, are handled at one
+//   request per cycle. only misses stall the pipeline.
+// - START_INIT invalidates all lines. the contexts themselves live in the
+//   output vector in external memory and are not touched, so the result is
+//   y + Ax for the y found there (like ExtContextMem). the host must fill
+//   y with the semiring zero to get y = Ax (see HWSpMV::setHWExtContext).
+// - START_FLUSH writes all dirty lines back
+// - misses evict the old line, writing it back first if dirty. saves
+//   overwrite the whole context, so they do not need to fetch on a miss.
+// loads and saves each respond in-order.
+
+class CachedContextMem(p: CachedContextMemParams) extends ContextMem(p) {
+  val inOrder = true
+  val indexBits = log2Up(p.lines)
+  val tagBits = p.idBits - indexBits
+  val bytesPerCtx = p.dataBits / 8
+
+  if(p.lines < 2 || (1 << indexBits) != p.lines)
+    throw new Exception("CachedContextMem lines must be a power of two")
+  if(tagBits <= 0)
+    throw new Exception("CachedContextMem too large, use BRAMContextMem")
+
+  // each line is stored as {valid, dirty, tag, data}
+  val lineBits = 2 + tagBits + p.dataBits
+  val mem = Module(new DualPortBRAM(indexBits, lineBits)).io
+  val rdPort = mem.ports(0)
+  val wrPort = mem.ports(1)
+  def makeLine(valid: Bool, dirty: Bool, tag: UInt, data: UInt): UInt = {
+    Cat(valid, dirty, tag, data)
+  }
+  def lineData(l: UInt): UInt = l(p.dataBits-1, 0)
+  def lineTag(l: UInt): UInt = l(p.dataBits+tagBits-1, p.dataBits)
+  def lineDirty(l: UInt): Bool = l(lineBits-2)
+  def lineValid(l: UInt): Bool = l(lineBits-1)
+
+  val sRun :: sWBReq :: sWBDat :: sWBRsp :: sFillReq :: sFillRsp :: sInit :: sFlushRead :: sFlush :: sFlushNext :: sFinished :: Nil = Enum(UInt(), 11)
+  val regState = Reg(init = UInt(sRun))
+  val running = (regState === sRun)
+
+  // lookup stage: the request whose line is being read from the BRAM
+  val s1Valid = Reg(init = Bool(false))
+  val s1Ind = Reg(init = UInt(0, p.idBits))
+  val s1Value = Reg(init = UInt(0, p.dataBits))
+  val s1IsSave = Reg(init = Bool(false))
+  val s1Line = s1Ind(indexBits-1, 0)
+  val s1Tag = s1Ind(p.idBits-1, indexBits)
+
+  // init/flush position, and the line being written back
+  val regLine = Reg(init = UInt(0, indexBits))
+  val regFlushing = Reg(init = Bool(false))
+  val regVictim = Reg(init = UInt(0, lineBits))
+  val regVictimInd = Reg(init = UInt(0, p.idBits))
+
+  // single write port for the lines
+  val wrEn = Bool()
+  val wrAddr = UInt(width = indexBits)
+  val wrLine = UInt(width = lineBits)
+  wrEn := Bool(false)
+  wrAddr := s1Line
+  wrLine := UInt(0)
+  wrPort.req.writeEn := wrEn
+  wrPort.req.addr := wrAddr
+  wrPort.req.writeData := wrLine
+
+  // a read in the same cycle as a write to the same line returns the old
+  // line, so the written line is forwarded to the lookup instead
+  val rdAddr = UInt(width = indexBits)
+  rdPort.req.writeEn := Bool(false)
+  rdPort.req.writeData := UInt(0)
+  rdPort.req.addr := rdAddr
+  val regRdAddr = Reg(next = rdAddr)
+  val regLastWrEn = Reg(init = Bool(false), next = wrEn)
+  val regLastWrAddr = Reg(next = wrAddr)
+  val regLastWrLine = Reg(next = wrLine)
+  val rdLine = Mux(regLastWrEn & (regLastWrAddr === regRdAddr),
+                   regLastWrLine, rdPort.rsp.readData)
+
+  val hit = lineValid(rdLine) & (lineTag(rdLine) === s1Tag)
+  val victimDirty = lineValid(rdLine) & lineDirty(rdLine) & !hit
+  // hits, and saves that do not evict a dirty line, finish in the lookup
+  val s1Fast = hit | (s1IsSave & !victimDirty)
+
+  // hit/miss statistics, cleared on init
+  val regHits = Reg(init = UInt(0, 32))
+  val regMisses = Reg(init = UInt(0, 32))
+  io.cacheHits := regHits
+  io.cacheMisses := regMisses
+
+  // response queues, requests are only accepted while both have room for
+  // the one in the lookup stage
+  val loadRspQ = Module(new FPGAQueue(io.contextLoadRsp.bits, 4)).io
+  val saveRspQ = Module(new FPGAQueue(io.contextSaveRsp.bits, 4)).io
+  loadRspQ.deq <> io.contextLoadRsp
+  saveRspQ.deq <> io.contextSaveRsp
+  loadRspQ.enq.valid := Bool(false)
+  loadRspQ.enq.bits := WorkUnit(lineData(rdLine), s1Value, s1Ind)
+  saveRspQ.enq.valid := Bool(false)
+  saveRspQ.enq.bits := s1Ind
+
+  // accept a new request when the lookup stage is free or finishing,
+  // saves first since they free up scheduler slots
+  val modeStart = io.start & !(io.mode === SeyrekModes.START_REGULAR)
+  val canIssue = running & !modeStart & (!s1Valid | s1Fast) &
+    (loadRspQ.count < UInt(2)) & (saveRspQ.count < UInt(2))
+  io.contextSaveReq.ready := canIssue
+  io.contextLoadReq.ready := canIssue & !io.contextSaveReq.valid
+  val issueSave = io.contextSaveReq.valid
+  val issueInd = Mux(issueSave, io.contextSaveReq.bits.ind, io.contextLoadReq.bits.ind)
+  val doIssue = canIssue & (io.contextSaveReq.valid | io.contextLoadReq.valid)
+  rdAddr := Mux(regState === sFlushRead, regLine, issueInd(indexBits-1, 0))
+
+  // external memory accesses, one context at a time
+  io.mainMem.memRdReq.valid := Bool(false)
+  io.mainMem.memRdReq.bits := GenericMemoryRequest(p.mrp,
+    io.contextBase + s1Ind * UInt(bytesPerCtx), Bool(false), UInt(p.chanID),
+    UInt(bytesPerCtx))
+  io.mainMem.memRdRsp.ready := Bool(false)
+  io.mainMem.memWrReq.valid := Bool(false)
+  io.mainMem.memWrReq.bits := GenericMemoryRequest(p.mrp,
+    io.contextBase + regVictimInd * UInt(bytesPerCtx), Bool(true), UInt(p.chanID),
+    UInt(bytesPerCtx))
+  io.mainMem.memWrDat.valid := Bool(false)
+  io.mainMem.memWrDat.bits := lineData(regVictim)
+  io.mainMem.memWrRsp.ready := Bool(false)
+
+  io.finished := Bool(false)
+
+  switch(regState) {
+    is(sRun) {
+      when(s1Valid) {
+        when(hit) { regHits := regHits + UInt(1) }
+        .otherwise { regMisses := regMisses + UInt(1) }
+
+        when(s1Fast) {
+          when(s1IsSave) {
+            wrEn := Bool(true)
+            wrLine := makeLine(Bool(true), Bool(true), s1Tag, s1Value)
+            saveRspQ.enq.valid := Bool(true)
+          } .otherwise { loadRspQ.enq.valid := Bool(true) }
+        } .otherwise {
+          // miss: evict the dirty line first, then fetch (loads only)
+          regVictim := rdLine
+          regVictimInd := Cat(lineTag(rdLine), s1Line)
+          regState := Mux(victimDirty, sWBReq, sFillReq)
+        }
+      }
+
+      when(!s1Valid | s1Fast) {
+        s1Valid := doIssue
+        s1Ind := issueInd
+        s1Value := Mux(issueSave, io.contextSaveReq.bits.value, io.contextLoadReq.bits.value)
+        s1IsSave := issueSave
+      }
+
+      when(modeStart & !s1Valid) {
+        regLine := UInt(0)
+        when(io.mode === SeyrekModes.START_INIT) {
+          regHits := UInt(0)
+          regMisses := UInt(0)
+          regState := sInit
+        } .elsewhen(io.mode === SeyrekModes.START_FLUSH) {
+          regState := sFlushRead
+        } .otherwise { regState := sFinished }
+      }
+    }
+
+    is(sWBReq) {
+      io.mainMem.memWrReq.valid := Bool(true)
+      when(io.mainMem.memWrReq.ready) { regState := sWBDat }
+    }
+
+    is(sWBDat) {
+      io.mainMem.memWrDat.valid := Bool(true)
+      when(io.mainMem.memWrDat.ready) { regState := sWBRsp }
+    }
+
+    is(sWBRsp) {
+      io.mainMem.memWrRsp.ready := Bool(true)
+      when(io.mainMem.memWrRsp.valid) {
+        when(regFlushing) {
+          wrEn := Bool(true)
+          wrAddr := regLine
+          wrLine := makeLine(Bool(true), Bool(false), lineTag(regVictim), lineData(regVictim))
+          regState := sFlushNext
+        } .elsewhen(s1IsSave) {
+          wrEn := Bool(true)
+          wrLine := makeLine(Bool(true), Bool(true), s1Tag, s1Value)
+          saveRspQ.enq.valid := Bool(true)
+          s1Valid := Bool(false)
+          regState := sRun
+        } .otherwise { regState := sFillReq }
+      }
+    }
+
+    is(sFillReq) {
+      io.mainMem.memRdReq.valid := Bool(true)
+      when(io.mainMem.memRdReq.ready) { regState := sFillRsp }
+    }
+
+    is(sFillRsp) {
+      io.mainMem.memRdRsp.ready := Bool(true)
+      loadRspQ.enq.bits.matrixVal := io.mainMem.memRdRsp.bits.readData
+      when(io.mainMem.memRdRsp.valid) {
+        wrEn := Bool(true)
+        wrLine := makeLine(Bool(true), Bool(false), s1Tag,
+                           io.mainMem.memRdRsp.bits.readData)
+        loadRspQ.enq.valid := Bool(true)
+        s1Valid := Bool(false)
+        regState := sRun
+      }
+    }
+
+    is(sInit) {
+      wrEn := Bool(true)
+      wrAddr := regLine
+      wrLine := UInt(0)
+      regLine := regLine + UInt(1)
+      when(regLine === UInt(p.lines-1)) { regState := sFinished }
+    }
+
+    is(sFlushRead) {
+      regFlushing := Bool(true)
+      regState := sFlush
+    }
+
+    is(sFlush) {
+      regVictim := rdLine
+      regVictimInd := Cat(lineTag(rdLine), regLine)
+      when(lineValid(rdLine) & lineDirty(rdLine)) { regState := sWBReq }
+      .otherwise { regState := sFlushNext }
+    }
+
+    is(sFlushNext) {
+      regLine := regLine + UInt(1)
+      when(regLine === UInt(p.lines-1)) {
+        regFlushing := Bool(false)
+        regState := sFinished
+      } .otherwise { regState := sFlushRead }
+    }
+
+    is(sFinished) {
+      io.finished := Bool(true)
+      when(!io.start) { regState := sRun }
+    }
+  }
+}
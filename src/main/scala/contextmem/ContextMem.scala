@@ -10,19 +10,45 @@ class ContextMemParams(
   val mrp: MemReqParams
 )
 
-class ContextMemIO(p: ContextMemParams) extends Bundle with SeyrekCtrlStat {
+// control, status and main memory signals common to all context memories
+class ContextMemCtrlIO(p: ContextMemParams) extends Bundle with SeyrekCtrlStat {
   // SeyrekCtrlStat is inherited from base trait
   // how many OMRs should be allocated (if applicable)
   val contextReqCnt = UInt(INPUT, 10)
+  // main memory access port
+  val mainMem = new GenericMemoryMasterPort(p.mrp)
+  val contextBase = UInt(INPUT, width = p.mrp.addrWidth)
+  // number of rows in the output vector at contextBase, flushes stop there
+  val contextRows = UInt(INPUT, width = 32)
+  // value that init writes into all contexts (the semiring zero)
+  val contextInit = UInt(INPUT, width = p.dataBits)
+  // statistics for context memories with a cache
+  val cacheHits = UInt(OUTPUT, 32)
+  val cacheMisses = UInt(OUTPUT, 32)
+}
+
+class ContextMemIO(p: ContextMemParams) extends ContextMemCtrlIO(p) {
   // context load port
   val contextLoadReq = Decoupled(new ValIndPair(p.dataBits, p.idBits)).flip
   val contextLoadRsp = Decoupled(new WorkUnit(p.dataBits, p.idBits))
   // context save port
   val contextSaveReq = Decoupled(new ValIndPair(p.dataBits, p.idBits)).flip
   val contextSaveRsp = Decoupled(UInt(width = p.idBits))
-  // main memory access port
-  val mainMem = new GenericMemoryMasterPort(p.mrp)
-  val contextBase = UInt(INPUT, width = p.mrp.addrWidth)
+}
+
+object ContextMem {
+  // number of contexts written back by a flush: the row count rounded up to
+  // whole memory beats, so that the flush StreamWriter only sees full beats.
+  // the host must leave room for the padding after the output vector.
+  def flushCount(p: ContextMemParams, rows: UInt): UInt = {
+    val perBeat = p.mrp.dataWidth / p.dataBits
+    if(perBeat <= 1) rows
+    else {
+      val padBits = log2Up(perBeat)
+      val padded = rows + UInt(perBeat - 1, width = 32)
+      Cat(padded(31, padBits), UInt(0, width = padBits))
+    }
+  }
 }
 
 // base abstract class for context storage memories
@@ -33,6 +59,10 @@ abstract class ContextMem(val p: ContextMemParams) extends Module {
   // whether the ContextMem responds to load/save commands in-order
   def inOrder: Boolean
 
+  // only driven by context memories with a cache
+  io.cacheHits := UInt(0)
+  io.cacheMisses := UInt(0)
+
   // useful printfs to debug ContextMem, uncomment as needed
   /*
   when(io.contextLoadReq.valid & io.contextLoadReq.ready) {
@@ -57,3 +87,27 @@ abstract class ContextMem(val p: ContextMemParams) extends Module {
   }
   */
 }
+
+// context memory split into <banks> banks, each with its own load and save
+// ports so that several frontend lanes can access contexts in parallel.
+// rows are interleaved across the banks: row r lives in bank r % banks.
+// the indices on all ports are global row indices.
+
+class BankedContextMemIO(p: ContextMemParams, banks: Int)
+extends ContextMemCtrlIO(p) {
+  val contextLoadReq = Vec.fill(banks) {Decoupled(new ValIndPair(p.dataBits, p.idBits)).flip}
+  val contextLoadRsp = Vec.fill(banks) {Decoupled(new WorkUnit(p.dataBits, p.idBits))}
+  val contextSaveReq = Vec.fill(banks) {Decoupled(new ValIndPair(p.dataBits, p.idBits)).flip}
+  val contextSaveRsp = Vec.fill(banks) {Decoupled(UInt(width = p.idBits))}
+}
+
+abstract class BankedContextMem(val p: ContextMemParams, val banks: Int)
+extends Module {
+  val io = new BankedContextMemIO(p, banks)
+
+  if(banks < 2 || (1 << log2Up(banks)) != banks)
+    throw new Exception("BankedContextMem needs a power-of-two bank count > 1")
+
+  io.cacheHits := UInt(0)
+  io.cacheMisses := UInt(0)
+}
@@ -0,0 +1,120 @@
+package Seyrek
+
+import Chisel._
+import TidbitsStreams._
+
+// scheduler with out-of-order dispatch and completion
+
+// instructions whose row index is already in flight are parked in a small
+// reservation buffer instead of blocking the input, so that independent
+// instructions behind them can still dispatch. buffered instructions are
+// dispatched (oldest eligible first, and in order among the same row) once
+// their row completes, and have priority over new instructions.
+// the input only stalls on a hazard when the reservation buffer is full.
+
+class OoODispatchScheduler(p: SeyrekParams, resvEntries: Int = 4)
+extends Scheduler(p) {
+  val dispatchOrdered = false
+  val completeOrdered = false
+
+  // in-flight table: row indices that have been issued but not completed
+  val regFlightValid = Vec.fill(p.issueWindow) {Reg(init = Bool(false))}
+  val regFlightInd = Vec.fill(p.issueWindow) {Reg(init = UInt(0, p.indWidth))}
+  // reservation buffer, kept compacted with the oldest entry at 0
+  val regResvValid = Vec.fill(resvEntries) {Reg(init = Bool(false))}
+  val regResvData = Vec.fill(resvEntries) {Reg(outType = p.vi)}
+
+  def isInFlight(ind: UInt): Bool = {
+    (0 until p.issueWindow).map(
+      i => regFlightValid(i) & regFlightInd(i) === ind
+    ).reduce(_ | _)
+  }
+
+  def isBuffered(ind: UInt, upTo: Int): Bool = {
+    (0 until upTo).map(
+      i => regResvValid(i) & regResvData(i).ind === ind
+    ).foldLeft(Bool(false))(_ | _)
+  }
+
+  // buffered entries whose row is free, and which have no older entry
+  // for the same row waiting in front of them
+  val resvCanGo = (0 until resvEntries).map(
+    i => regResvValid(i) & !isInFlight(regResvData(i).ind) &
+         !isBuffered(regResvData(i).ind, i)
+  )
+  val resvAnyGo = resvCanGo.reduce(_ | _)
+  val resvGoSel = PriorityEncoder(resvCanGo)
+  val resvHasFree = !regResvValid(resvEntries - 1)
+  val resvCount = PopCount(regResvValid)
+
+  val flightFree = regFlightValid.map(x => !x)
+  val flightHasFree = flightFree.reduce(_ | _)
+  val flightFreeSel = PriorityEncoder(flightFree)
+
+  // new instructions for rows in flight or waiting in the buffer must wait
+  val instrHazard = isInFlight(io.instr.bits.ind) |
+                    isBuffered(io.instr.bits.ind, resvEntries)
+  // the buffer gets priority on the single dispatch port
+  val issueFromResv = resvAnyGo & flightHasFree
+  val issueFromInstr = !resvAnyGo & flightHasFree & !instrHazard
+
+  io.issue.valid := issueFromResv | (issueFromInstr & io.instr.valid)
+  io.issue.bits := Mux(issueFromResv, regResvData(resvGoSel), io.instr.bits)
+  io.instr.ready := (issueFromInstr & io.issue.ready) |
+                    (instrHazard & resvHasFree)
+
+  val doIssue = io.issue.valid & io.issue.ready
+  val resvRemove = issueFromResv & io.issue.ready
+  val resvInsert = io.instr.valid & io.instr.ready & instrHazard
+
+  // update the reservation buffer: shift the entries after a removed one
+  // down by one, then put a newly hazarding instruction at the end
+  val insertPos = resvCount - resvRemove
+  for(i <- 0 until resvEntries) {
+    val shift = resvRemove & (UInt(i) >= resvGoSel)
+    if(i == resvEntries - 1) {
+      when(shift) { regResvValid(i) := Bool(false) }
+    } else {
+      when(shift) {
+        regResvValid(i) := regResvValid(i+1)
+        regResvData(i) := regResvData(i+1)
+      }
+    }
+    when(resvInsert & insertPos === UInt(i)) {
+      regResvValid(i) := Bool(true)
+      regResvData(i) := io.instr.bits
+    }
+  }
+
+  // dispatched instructions take a free in-flight slot
+  when(doIssue) {
+    regFlightValid(flightFreeSel) := Bool(true)
+    regFlightInd(flightFreeSel) := io.issue.bits.ind
+  }
+
+  // completions may arrive in any order and free the matching slot
+  io.compl.ready := Bool(true)
+  for(i <- 0 until p.issueWindow) {
+    when(io.compl.valid & regFlightValid(i) & regFlightInd(i) === io.compl.bits) {
+      regFlightValid(i) := Bool(false)
+    }
+  }
+
+  // hazard and bypass counting logic
+  // a bypass is a dispatch that overtakes an older waiting instruction
+  val regHazardStalls = Reg(init = UInt(0, 32))
+  val regBypasses = Reg(init = UInt(0, 32))
+  val regHazard = Reg(next = io.instr.valid & instrHazard & !resvHasFree)
+  val regBypass = Reg(next = doIssue & Mux(issueFromResv,
+    !(resvGoSel === UInt(0)), regResvValid(0)))
+  val regStart = Reg(next = io.start)
+  when(!regStart & io.start) {
+    regHazardStalls := UInt(0)
+    regBypasses := UInt(0)
+  } .elsewhen(regStart) {
+    when(regHazard) { regHazardStalls := regHazardStalls + UInt(1) }
+    when(regBypass) { regBypasses := regBypasses + UInt(1) }
+  }
+  io.hazardStallCycles := regHazardStalls
+  io.bypassCount := regBypasses
+}
@@ -25,10 +25,14 @@ class SchedulerIO(p: SeyrekParams) extends Bundle with SeyrekCtrlStat {
   val compl = Decoupled(p.i).flip
   // statistics
   val hazardStallCycles = UInt(OUTPUT, 32)
+  // instructions dispatched ahead of older ones (out-of-order dispatch)
+  val bypassCount = UInt(OUTPUT, 32)
 }
 
 abstract class Scheduler(p: SeyrekParams) extends Module {
   val io = new SchedulerIO(p)
+  // only meaningful for schedulers with out-of-order dispatch
+  io.bypassCount := UInt(0)
 
   // indicate how the scheduler behaves with its instructions scheduling
   def dispatchOrdered: Boolean  // whether dispatches are in-order
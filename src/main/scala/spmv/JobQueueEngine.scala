@@ -0,0 +1,171 @@
+package Seyrek
+
+import Chisel._
+import TidbitsDMA._
+
+// runs SpMV jobs from a descriptor ring in accelerator-visible memory,
+// so that the host needs a single doorbell write for a batch of jobs
+// instead of programming the PE registers and polling for each mode.
+//
+// the ring has <slots> (a power of two) slots of 128 bytes at base:
+// - bytes 0..63: the job descriptor, in 64-bit words
+//   0: colPtr, 1: rowInd, 2: nzData, 3: inpVec, 4: outVec
+//   5: rows (31..0), cols (63..32)
+//   6: nz (31..0), modes (35..32: bit 0 init, bit 1 regular, bit 2 flush)
+//   7: semiringSel (7..0)
+//   there is no room for the context init value, init uses the contextInit
+//   register of the PE (the host sets it with the semiring in any case)
+// - bytes 64..127: the completion record, written by the engine
+//   0: job number (31..0), done flag (32)
+//   1..n: snapshot of the PE counters at the end of the regular mode
+// the host advances tail (the doorbell) after writing descriptors, and the
+// engine runs jobs until head catches up. must match jobqueue.hpp.
+
+class JobQueueEngine(p: SeyrekParams, numCounters: Int) extends Module {
+  val io = new Bundle {
+    // ring configuration and doorbell
+    val base = UInt(INPUT, width = p.ptrWidth)
+    val slots = UInt(INPUT, width = 32)
+    val tail = UInt(INPUT, width = 32)
+    val head = UInt(OUTPUT, width = 32)
+    // PE control while a job is running (active)
+    val active = Bool(OUTPUT)
+    val start = Bool(OUTPUT)
+    val mode = UInt(OUTPUT, width = 10)
+    val csc = new CSCSpMV(p).asOutput
+    val semiringSel = UInt(OUTPUT, width = SemiringOps.selWidth)
+    val finished = Bool(INPUT)
+    val counters = Vec.fill(numCounters) {UInt(INPUT, width = 32)}
+    // descriptor reads and completion writes
+    val mem = new GenericMemoryMasterPort(p.mrp)
+  }
+  val wordsPerRecord = 8
+  val bytesPerRecord = wordsPerRecord * 8
+  if(p.mrp.dataWidth != 64)
+    throw new Exception("JobQueueEngine needs a 64-bit memory interface")
+  if(numCounters > wordsPerRecord - 1)
+    throw new Exception("Too many counters for JobQueueEngine completion records")
+
+  val regHead = Reg(init = UInt(0, 32))
+  val regDesc = Vec.fill(wordsPerRecord) {Reg(init = UInt(0, 64))}
+  val regCompl = Vec.fill(wordsPerRecord) {Reg(init = UInt(0, 64))}
+  val regWord = Reg(init = UInt(0, log2Up(wordsPerRecord)+1))
+  // current mode in the init -> regular -> flush sequence
+  val regModeInd = Reg(init = UInt(0, 2))
+  val regLowCycles = Reg(init = UInt(0, 3))
+  io.head := regHead
+
+  val slotAddr = io.base + ((regHead & (io.slots - UInt(1))) << UInt(7))
+  val modeSeq = Vec(SeyrekModes.START_INIT, SeyrekModes.START_REGULAR,
+    SeyrekModes.START_FLUSH)
+  val modeBits = regDesc(6)(35, 32)
+  val currentMode = modeSeq(regModeInd)
+
+  io.active := !(regHead === io.tail)
+  io.start := Bool(false)
+  io.mode := currentMode
+  io.csc.colPtr := regDesc(0)
+  io.csc.rowInd := regDesc(1)
+  io.csc.nzData := regDesc(2)
+  io.csc.inpVec := regDesc(3)
+  io.csc.outVec := regDesc(4)
+  io.csc.rows := regDesc(5)(31, 0)
+  io.csc.cols := regDesc(5)(63, 32)
+  io.csc.nz := regDesc(6)(31, 0)
+  io.semiringSel := regDesc(7)(7, 0)
+
+  io.mem.memRdReq.valid := Bool(false)
+  io.mem.memRdReq.bits := GenericMemoryRequest(p.mrp, slotAddr, Bool(false),
+    UInt(0), UInt(bytesPerRecord))
+  io.mem.memRdRsp.ready := Bool(false)
+  io.mem.memWrReq.valid := Bool(false)
+  io.mem.memWrReq.bits := GenericMemoryRequest(p.mrp,
+    slotAddr + UInt(bytesPerRecord), Bool(true), UInt(0), UInt(bytesPerRecord))
+  io.mem.memWrDat.valid := Bool(false)
+  io.mem.memWrDat.bits := regCompl(regWord)
+  io.mem.memWrRsp.ready := Bool(false)
+
+  val sIdle :: sReadReq :: sReadRsp :: sMode :: sModeWait :: sModeLow :: sWriteReq :: sWriteDat :: sWriteRsp :: Nil = Enum(UInt(), 9)
+  val regState = Reg(init = UInt(sIdle))
+
+  switch(regState) {
+    is(sIdle) {
+      when(io.active) { regState := sReadReq }
+    }
+
+    is(sReadReq) {
+      io.mem.memRdReq.valid := Bool(true)
+      regWord := UInt(0)
+      // jobs without a regular mode report zero counters
+      for(i <- 0 until wordsPerRecord)
+        regCompl(i) := UInt(0)
+      when(io.mem.memRdReq.ready) { regState := sReadRsp }
+    }
+
+    is(sReadRsp) {
+      io.mem.memRdRsp.ready := Bool(true)
+      when(io.mem.memRdRsp.valid) {
+        regDesc(regWord) := io.mem.memRdRsp.bits.readData
+        regWord := regWord + UInt(1)
+        when(regWord === UInt(wordsPerRecord-1)) {
+          regModeInd := UInt(0)
+          regState := sMode
+        }
+      }
+    }
+
+    is(sMode) {
+      // skip the modes not requested by the job
+      when(modeBits(regModeInd)) { regState := sModeWait }
+      .elsewhen(regModeInd === UInt(2)) { regState := sWriteReq }
+      .otherwise { regModeInd := regModeInd + UInt(1) }
+    }
+
+    is(sModeWait) {
+      io.start := Bool(true)
+      when(io.finished) {
+        when(currentMode === SeyrekModes.START_REGULAR) {
+          for(i <- 0 until numCounters)
+            regCompl(i+1) := io.counters(i)
+        }
+        regLowCycles := UInt(0)
+        regState := sModeLow
+      }
+    }
+
+    is(sModeLow) {
+      // keep start low for a few cycles so that the PE returns to idle
+      regLowCycles := regLowCycles + UInt(1)
+      when(regLowCycles === UInt(3)) {
+        when(regModeInd === UInt(2)) { regState := sWriteReq }
+        .otherwise {
+          regModeInd := regModeInd + UInt(1)
+          regState := sMode
+        }
+      }
+    }
+
+    is(sWriteReq) {
+      regCompl(0) := Cat(UInt(1, 32), regHead)
+      regWord := UInt(0)
+      io.mem.memWrReq.valid := Bool(true)
+      when(io.mem.memWrReq.ready) { regState := sWriteDat }
+    }
+
+    is(sWriteDat) {
+      io.mem.memWrDat.valid := Bool(true)
+      when(io.mem.memWrDat.ready) {
+        regWord := regWord + UInt(1)
+        when(regWord === UInt(wordsPerRecord-1)) { regState := sWriteRsp }
+      }
+    }
+
+    is(sWriteRsp) {
+      io.mem.memWrRsp.ready := Bool(true)
+      when(io.mem.memWrRsp.valid) {
+        regHead := regHead + UInt(1)
+        regState := sIdle
+      }
+    }
+  }
+}
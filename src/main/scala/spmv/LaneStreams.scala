@@ -0,0 +1,150 @@
+package Seyrek
+
+import Chisel._
+import TidbitsStreams._
+
+// building blocks for frontends with several lanes, where the backend
+// delivers up to <lanes> work units per cycle (one per lane) and each
+// lane's results go to the context memory bank that holds their row
+
+// a group of up to <lanes> values, the first <count> of which are valid
+class LaneGroup(lanes: Int, w: Int) extends Bundle {
+  val vals = Vec.fill(lanes) {UInt(width = w)}
+  val count = UInt(width = log2Up(lanes+1))
+
+  override def cloneType: this.type =
+    new LaneGroup(lanes, w).asInstanceOf[this.type]
+}
+
+// wide version of StreamRepeatElem: repeats each element of elems <len>
+// times (len taken from lens), and packs the repeated elements into groups
+// of <lanes>, so that group i holds repeated elements i*lanes ... The last
+// group is partial if total is not a multiple of lanes.
+// a column (len, elem) is fetched per cycle, so the group rate is only
+// lower than one per cycle when the columns are shorter than lanes.
+class WideRepeatElem(lanes: Int, w: Int, lenW: Int) extends Module {
+  val io = new Bundle {
+    val start = Bool(INPUT)
+    // total number of repeated elements (sum of all lens)
+    val total = UInt(INPUT, width = 32)
+    val lens = Decoupled(UInt(width = lenW)).flip
+    val elems = Decoupled(UInt(width = w)).flip
+    val out = Decoupled(new LaneGroup(lanes, w))
+  }
+  val cntW = log2Up(lanes+1)
+  // current element and how many times it still needs to be repeated
+  val regHaveElem = Reg(init = Bool(false))
+  val regElem = Reg(init = UInt(0, w))
+  val regRemain = Reg(init = UInt(0, lenW))
+  // group being filled
+  val regGroup = Vec.fill(lanes) {Reg(init = UInt(0, w))}
+  val regFill = Reg(init = UInt(0, cntW))
+  val regEmitted = Reg(init = UInt(0, 32))
+  // output register
+  val regOutValid = Reg(init = Bool(false))
+  val regOut = Reg(outType = new LaneGroup(lanes, w))
+
+  io.out.valid := regOutValid
+  io.out.bits := regOut
+  when(io.out.ready) { regOutValid := Bool(false) }
+
+  // the group is complete when full, or when it holds the last elements
+  val groupDone = (regFill === UInt(lanes)) |
+    (!(regFill === UInt(0)) & (regEmitted + regFill === io.total))
+  val transfer = groupDone & (!regOutValid | io.out.ready)
+  when(transfer) {
+    regOutValid := Bool(true)
+    regOut.vals := regGroup
+    regOut.count := regFill
+    regEmitted := regEmitted + regFill
+  }
+
+  // fill the group from the current element, starting over if the
+  // previous group is moved out in this cycle
+  val base = Mux(transfer, UInt(0, cntW), regFill)
+  val space = UInt(lanes) - base
+  val canFill = regHaveElem & (!groupDone | transfer)
+  val take = Mux(regRemain < space, regRemain, space)
+  val lastOfElem = canFill & (take === regRemain)
+  for(l <- 0 until lanes) {
+    when(canFill & (UInt(l) >= base) & (UInt(l) < base + take)) {
+      regGroup(l) := regElem
+    }
+  }
+  regFill := Mux(canFill, base + take, base)
+  when(canFill) { regRemain := regRemain - take }
+  when(lastOfElem) { regHaveElem := Bool(false) }
+
+  // fetch the next element when the current one is used up
+  val fetch = io.start & (!regHaveElem | lastOfElem) & io.lens.valid & io.elems.valid
+  io.lens.ready := fetch
+  io.elems.ready := fetch
+  when(fetch) {
+    regElem := io.elems.bits
+    regRemain := io.lens.bits
+    regHaveElem := !(io.lens.bits === UInt(0))
+  }
+
+  when(!io.start) {
+    regHaveElem := Bool(false)
+    regFill := UInt(0)
+    regEmitted := UInt(0)
+    regOutValid := Bool(false)
+  }
+}
+
+// splits lockstep groups of (matrix value, row index) pairs and repeated
+// vector values into one work unit stream per lane. a group moves on when
+// every lane with a valid element can take it.
+class LaneSplitter(p: SeyrekParams) extends Module {
+  val lanes = p.frontendLanes
+  val io = new Bundle {
+    // packed matrix values and row indices, lane 0 in the lowest bits
+    val nzData = Decoupled(UInt(width = lanes * p.valWidth)).flip
+    val rowInds = Decoupled(UInt(width = lanes * p.indWidth)).flip
+    val vecVals = Decoupled(new LaneGroup(lanes, p.valWidth)).flip
+    val out = Vec.fill(lanes) {Decoupled(p.wu)}
+  }
+  val allValid = io.nzData.valid & io.rowInds.valid & io.vecVals.valid
+  val active = (0 until lanes).map(l => UInt(l) < io.vecVals.bits.count)
+  val laneOK = (0 until lanes).map(l => !active(l) | io.out(l).ready)
+  val fire = allValid & laneOK.reduce(_ & _)
+  io.nzData.ready := fire
+  io.rowInds.ready := fire
+  io.vecVals.ready := fire
+
+  for(l <- 0 until lanes) {
+    io.out(l).valid := fire & active(l)
+    io.out(l).bits := WorkUnit(
+      io.nzData.bits((l+1)*p.valWidth-1, l*p.valWidth),
+      io.vecVals.bits.vals(l),
+      io.rowInds.bits((l+1)*p.indWidth-1, l*p.indWidth)
+    )
+  }
+}
+
+// routes the (value, row) streams of the lanes to the context memory banks,
+// row r goes to bank r % lanes. each bank takes one pair per cycle, lanes
+// competing for the same bank are served round-robin.
+class LaneCrossbar(p: SeyrekParams) extends Module {
+  val lanes = p.frontendLanes
+  val io = new Bundle {
+    val in = Vec.fill(lanes) {Decoupled(p.vi).flip}
+    val out = Vec.fill(lanes) {Decoupled(p.vi)}
+  }
+  val bankBits = log2Up(lanes)
+  val arbs = (0 until lanes).map(b => Module(new RRArbiter(p.vi, lanes)).io)
+
+  for(l <- 0 until lanes) {
+    val bank = io.in(l).bits.ind(bankBits-1, 0)
+    val bankReady = Vec(arbs.map(a => a.in(l).ready))
+    io.in(l).ready := bankReady(bank)
+    for(b <- 0 until lanes) {
+      arbs(b).in(l).valid := io.in(l).valid & (bank === UInt(b))
+      arbs(b).in(l).bits := io.in(l).bits
+    }
+  }
+  for(b <- 0 until lanes) {
+    arbs(b).out <> io.out(b)
+  }
+}
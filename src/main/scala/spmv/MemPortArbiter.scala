@@ -0,0 +1,109 @@
+package Seyrek
+
+import Chisel._
+import TidbitsDMA._
+import TidbitsStreams._
+
+// lets several memory clients (e.g. the backends of several PEs) share one
+// platform memory port.
+// - requests are arbitrated round-robin, separately for reads and writes
+// - each client gets its own range of idsPerClient channel IDs: the
+//   client's IDs are offset into its range on the way out, and responses
+//   are routed back (and the offset removed) based on the range they fall in
+// - write data beats are forwarded in the same order the write requests
+//   were granted in, using a small queue of (client, beats) entries
+
+class WriteOrderEntry(clientBits: Int, beatBits: Int) extends Bundle {
+  val client = UInt(width = clientBits)
+  val beats = UInt(width = beatBits)
+
+  override def cloneType: this.type =
+    new WriteOrderEntry(clientBits, beatBits).asInstanceOf[this.type]
+}
+
+class MemPortArbiter(mrp: MemReqParams, numClients: Int, idsPerClient: Int,
+  writeOrderEntries: Int = 8) extends Module {
+  val io = new Bundle {
+    val clients = Vec.fill(numClients) {new GenericMemoryMasterPort(mrp).flip}
+    val mem = new GenericMemoryMasterPort(mrp)
+  }
+  val idBitsPerClient = log2Up(idsPerClient)
+  val clientBits = log2Up(numClients)
+  val bytesPerBeat = mrp.dataWidth / 8
+  val beatBits = 8  // enough for the beats of a single request
+
+  if(numClients < 2)
+    throw new Exception("MemPortArbiter needs at least two clients")
+  if((1 << idBitsPerClient) != idsPerClient)
+    throw new Exception("MemPortArbiter idsPerClient must be a power of two")
+  if(idBitsPerClient + clientBits > mrp.idWidth)
+    throw new Exception("Not enough channel ID bits for MemPortArbiter")
+
+  def clientOf(id: UInt): UInt = {
+    id(idBitsPerClient + clientBits - 1, idBitsPerClient)
+  }
+
+  // read and write requests, with the channel IDs moved into client ranges
+  val rdArb = Module(new RRArbiter(new GenericMemoryRequest(mrp), numClients)).io
+  val wrArb = Module(new RRArbiter(new GenericMemoryRequest(mrp), numClients)).io
+  for(i <- 0 until numClients) {
+    val c = io.clients(i)
+    rdArb.in(i).valid := c.memRdReq.valid
+    rdArb.in(i).bits := c.memRdReq.bits
+    rdArb.in(i).bits.channelID := c.memRdReq.bits.channelID + UInt(i * idsPerClient)
+    c.memRdReq.ready := rdArb.in(i).ready
+
+    wrArb.in(i).valid := c.memWrReq.valid
+    wrArb.in(i).bits := c.memWrReq.bits
+    wrArb.in(i).bits.channelID := c.memWrReq.bits.channelID + UInt(i * idsPerClient)
+    c.memWrReq.ready := wrArb.in(i).ready
+  }
+  rdArb.out <> io.mem.memRdReq
+
+  // a write request is only let through if its data order can be recorded
+  val wrOrderQ = Module(new FPGAQueue(
+    new WriteOrderEntry(clientBits, beatBits), writeOrderEntries)).io
+  io.mem.memWrReq.valid := wrArb.out.valid & wrOrderQ.enq.ready
+  io.mem.memWrReq.bits := wrArb.out.bits
+  wrArb.out.ready := io.mem.memWrReq.ready & wrOrderQ.enq.ready
+  wrOrderQ.enq.valid := wrArb.out.valid & io.mem.memWrReq.ready
+  wrOrderQ.enq.bits.client := wrArb.chosen
+  wrOrderQ.enq.bits.beats := (wrArb.out.bits.numBytes + UInt(bytesPerBeat-1)) / UInt(bytesPerBeat)
+
+  // write data comes from the client at the head of the order queue
+  val wrDatClient = wrOrderQ.deq.bits.client
+  val wrDatValid = Vec(io.clients.map(c => c.memWrDat.valid))
+  val wrDatBits = Vec(io.clients.map(c => c.memWrDat.bits))
+  io.mem.memWrDat.valid := wrOrderQ.deq.valid & wrDatValid(wrDatClient)
+  io.mem.memWrDat.bits := wrDatBits(wrDatClient)
+  for(i <- 0 until numClients) {
+    io.clients(i).memWrDat.ready := wrOrderQ.deq.valid & io.mem.memWrDat.ready &
+      (wrDatClient === UInt(i))
+  }
+  val regBeat = Reg(init = UInt(0, beatBits))
+  val datFire = io.mem.memWrDat.valid & io.mem.memWrDat.ready
+  val lastBeat = (regBeat === wrOrderQ.deq.bits.beats - UInt(1))
+  wrOrderQ.deq.ready := datFire & lastBeat
+  when(datFire) {
+    when(lastBeat) { regBeat := UInt(0) }
+    .otherwise { regBeat := regBeat + UInt(1) }
+  }
+
+  // route read and write responses back by channel ID range
+  val rdRspClient = clientOf(io.mem.memRdRsp.bits.channelID)
+  val wrRspClient = clientOf(io.mem.memWrRsp.bits.channelID)
+  val rdRspReady = Vec(io.clients.map(c => c.memRdRsp.ready))
+  val wrRspReady = Vec(io.clients.map(c => c.memWrRsp.ready))
+  io.mem.memRdRsp.ready := rdRspReady(rdRspClient)
+  io.mem.memWrRsp.ready := wrRspReady(wrRspClient)
+  for(i <- 0 until numClients) {
+    val c = io.clients(i)
+    c.memRdRsp.valid := io.mem.memRdRsp.valid & (rdRspClient === UInt(i))
+    c.memRdRsp.bits := io.mem.memRdRsp.bits
+    c.memRdRsp.bits.channelID := io.mem.memRdRsp.bits.channelID - UInt(i * idsPerClient)
+
+    c.memWrRsp.valid := io.mem.memWrRsp.valid & (wrRspClient === UInt(i))
+    c.memWrRsp.bits := io.mem.memWrRsp.bits
+    c.memWrRsp.bits.channelID := io.mem.memWrRsp.bits.channelID - UInt(i * idsPerClient)
+  }
+}
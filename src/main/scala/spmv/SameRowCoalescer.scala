@@ -0,0 +1,63 @@
+package Seyrek
+
+import Chisel._
+import TidbitsMath._
+
+// pre-reduction stage for the multiplied (value, row) pairs: adjacent pairs
+// for the same row are merged with the semiring add before they reach the
+// scheduler, saving a context load -> add -> save trip (and a potential
+// hazard) for each merge.
+// one pair is held back to compare against the next one. it is released
+// as soon as the next pair is for a different row, or when no next pair
+// is available. the held pair cannot move while a merge is in the adder.
+
+class SameRowCoalescer(p: SeyrekParams) extends Module {
+  val io = new Bundle {
+    val start = Bool(INPUT)
+    // add op selection, only used with selectable semirings
+    val sel = UInt(INPUT, width = SemiringOps.opSelWidth)
+    val in = Decoupled(p.vi).flip
+    val out = Decoupled(p.vi)
+    // number of merged pairs since start
+    val merges = UInt(OUTPUT, 32)
+  }
+  val add = SemiringOp(p, p.makeSemiringAdd, SemiringOps.addFxns, io.sel)
+
+  val regValid = Reg(init = Bool(false))
+  val regBusy = Reg(init = Bool(false))
+  val regHeld = Reg(outType = p.vi)
+
+  val sameRow = regValid & io.in.valid & (io.in.bits.ind === regHeld.ind)
+
+  io.out.valid := regValid & !regBusy & !sameRow
+  io.out.bits := regHeld
+  val release = io.out.valid & io.out.ready
+
+  add.in.valid := sameRow & !regBusy
+  add.in.bits := BinaryMathOperands(regHeld.value, io.in.bits.value)
+  add.out.ready := regBusy
+
+  val doMerge = add.in.valid & add.in.ready
+  val canHold = !regValid | release
+  io.in.ready := doMerge | canHold
+
+  when(doMerge) { regBusy := Bool(true) }
+  when(regBusy & add.out.valid) {
+    regHeld.value := add.out.bits
+    regBusy := Bool(false)
+  }
+  when(release) { regValid := Bool(false) }
+  when(io.in.valid & canHold) {
+    regValid := Bool(true)
+    regHeld := io.in.bits
+  }
+
+  // merge counting logic
+  val regMerges = Reg(init = UInt(0, 32))
+  val regStart = Reg(next = io.start)
+  when(!regStart & io.start) { regMerges := UInt(0)}
+  .elsewhen(doMerge) {
+    regMerges := regMerges + UInt(1)
+  }
+  io.merges := regMerges
+}
@@ -3,6 +3,7 @@ package Seyrek
 import Chisel._
 import TidbitsPlatformWrapper._
 import TidbitsStreams._
+import TidbitsDMA._
 
 class SpMVProcElemIF(pSeyrek: SeyrekParams) extends Bundle {
   val start = Bool(INPUT)
@@ -13,11 +14,29 @@ class SpMVProcElemIF(pSeyrek: SeyrekParams) extends Bundle {
   // performance counter access
   val perfCtrSel = UInt(INPUT, width = 10)
   val perfCtrVal = UInt(OUTPUT, width = 32)
+  // op selection for accelerators with a selectable semiring
+  val semiringSel = UInt(INPUT, width = SemiringOps.selWidth)
+  // job descriptor ring (see JobQueueEngine), tail is the doorbell
+  val jobQueueBase = UInt(INPUT, width = pSeyrek.ptrWidth)
+  val jobQueueSlots = UInt(INPUT, width = 32)
+  val jobTail = UInt(INPUT, width = 32)
+  val jobHead = UInt(OUTPUT, width = 32)
+  // value written into all contexts by init (the semiring zero), also used
+  // for jobs from the job queue. 64 bits for all value widths, so that the
+  // register layout does not depend on the accelerator
+  val contextInit = UInt(INPUT, width = 64)
 }
 
 class SpMVAccel(p: PlatformWrapperParams, pSeyrek: SeyrekParams)
 extends GenericAccelerator(p) {
-  val numMemPorts = pSeyrek.numPEs * pSeyrek.portsPerPE
+  // the backends of all PEs need numPEs * portsPerPE memory ports in total,
+  // plus one per PE for the job queue engines if enabled. if the platform
+  // has fewer, client port g goes to platform port g % numMemPorts, and the
+  // ports used by several clients are shared through MemPortArbiters
+  val numBackendPorts = pSeyrek.numPEs * pSeyrek.portsPerPE
+  val numJobPorts = if(pSeyrek.jobQueue) pSeyrek.numPEs else 0
+  val numMemClients = numBackendPorts + numJobPorts
+  val numMemPorts = math.min(p.numMemPorts, numMemClients)
   val io = new GenericAcceleratorIF(numMemPorts, p) {
     val pe = Vec.fill(pSeyrek.numPEs) {new SpMVProcElemIF(pSeyrek)}
   }
@@ -25,27 +44,43 @@ extends GenericAccelerator(p) {
   io.signature := makeDefaultSignature()
 
   var fullPerfCtrMap = scala.collection.mutable.Map[String, Int]()
+  val memClients = new Array[GenericMemoryMasterPort](numMemClients)
 
   for(i <- 0 until pSeyrek.numPEs) {
     val backend = Module(new SpMVBackend(pSeyrek))
     val frontend = Module(new SpMVFrontend(pSeyrek))
     val ioPE = io.pe(i)
 
+    // the PE is controlled from its registers, or by the job queue engine
+    // while that has jobs to run
+    val peStart = Bool()
+    val peMode = UInt(width = 10)
+    val peCsc = new CSCSpMV(pSeyrek)
+    val peSemiringSel = UInt(width = SemiringOps.selWidth)
+    peStart := ioPE.start
+    peMode := ioPE.mode
+    peCsc := ioPE.csc
+    peSemiringSel := ioPE.semiringSel
+
     backend.io.contextReqCnt := ioPE.contextReqCnt
-    backend.io.start := ioPE.start
-    frontend.io.start := ioPE.start
+    backend.io.contextInit := ioPE.contextInit(pSeyrek.valWidth-1, 0)
+    backend.io.semiringSel := peSemiringSel
+    backend.io.start := peStart
+    frontend.io.start := peStart
 
-    backend.io.mode := ioPE.mode
-    frontend.io.mode := ioPE.mode
+    backend.io.mode := peMode
+    frontend.io.mode := peMode
+    frontend.io.semiringSel := peSemiringSel
 
-    ioPE.finished := Mux(ioPE.mode === SeyrekModes.START_REGULAR,
+    val peFinished = Mux(peMode === SeyrekModes.START_REGULAR,
                       frontend.io.finished, backend.io.finished)
+    ioPE.finished := peFinished
 
-    ioPE.csc <> backend.io.csc
+    backend.io.csc := peCsc
     for(mp <- 0 until pSeyrek.portsPerPE)
-      backend.io.mainMem(mp) <> io.memPort(i * pSeyrek.portsPerPE + mp)
+      memClients(i * pSeyrek.portsPerPE + mp) = backend.io.mainMem(mp)
 
-    ioPE.csc <> frontend.io.csc
+    frontend.io.csc := peCsc
     backend.io.workUnits <> frontend.io.workUnits
 
     frontend.io.contextLoadReq <> backend.io.contextLoadReq
@@ -56,20 +91,45 @@ extends GenericAccelerator(p) {
     // keep a per-PE cycle count register, tracks time start -> finished
     val regCycleCount = Reg(init = UInt(0, 32))
 
-    when(!ioPE.start) {regCycleCount := UInt(0)}
-    .elsewhen(ioPE.start & !ioPE.finished) {
+    when(!peStart) {regCycleCount := UInt(0)}
+    .elsewhen(peStart & !peFinished) {
       regCycleCount := regCycleCount + UInt(1)
     }
 
-    val yes = ioPE.start & !ioPE.finished
+    // descriptor-based job submission, the completion records get a
+    // snapshot of these counters
+    val jobCounters = Seq(regCycleCount, frontend.io.hazardStallCycles,
+      frontend.io.bypassCount, frontend.io.coalescedMerges,
+      backend.io.contextCacheHits, backend.io.contextCacheMisses)
+    ioPE.jobHead := UInt(0)
+    if(pSeyrek.jobQueue) {
+      val jobs = Module(new JobQueueEngine(pSeyrek, jobCounters.size)).io
+      jobs.base := ioPE.jobQueueBase
+      jobs.slots := ioPE.jobQueueSlots
+      jobs.tail := ioPE.jobTail
+      ioPE.jobHead := jobs.head
+      jobs.finished := peFinished
+      for(c <- 0 until jobCounters.size)
+        jobs.counters(c) := jobCounters(c)
+      memClients(numBackendPorts + i) = jobs.mem
+      when(jobs.active) {
+        peStart := jobs.start
+        peMode := jobs.mode
+        peCsc := jobs.csc
+        peSemiringSel := jobs.semiringSel
+      }
+    }
+
+    val yes = peStart & !peFinished
     // StreamMonitors for general progress monitoring
     // also output as printfs on the Chisel C++ emulator
     // TODO control the printfs
-    val monWU = StreamMonitor(frontend.io.workUnits, yes, s"$i workUnits")
-    val monCLQ = StreamMonitor(frontend.io.contextLoadReq, yes, s"$i contextLoadReq")
-    val monCSQ = StreamMonitor(frontend.io.contextSaveReq, yes, s"$i contextSaveReq")
-    val monCLP = StreamMonitor(frontend.io.contextLoadRsp, yes, s"$i contextLoadRsp")
-    val monCSP = StreamMonitor(frontend.io.contextSaveRsp, yes, s"$i contextSaveRsp")
+    // (only lane 0 is monitored for multi-lane frontends)
+    val monWU = StreamMonitor(frontend.io.workUnits(0), yes, s"$i workUnits")
+    val monCLQ = StreamMonitor(frontend.io.contextLoadReq(0), yes, s"$i contextLoadReq")
+    val monCSQ = StreamMonitor(frontend.io.contextSaveReq(0), yes, s"$i contextSaveReq")
+    val monCLP = StreamMonitor(frontend.io.contextLoadRsp(0), yes, s"$i contextLoadRsp")
+    val monCSP = StreamMonitor(frontend.io.contextSaveRsp(0), yes, s"$i contextSaveRsp")
 
     // performance counter stuff
     val regPerfCtrSel = Reg(next = ioPE.perfCtrSel)
@@ -77,6 +137,10 @@ extends GenericAccelerator(p) {
     val perfCtrMap = Map[String, Data](
       "cycleCount" -> regCycleCount,
       "hazardStallCycles" -> frontend.io.hazardStallCycles,
+      "bypassCount" -> frontend.io.bypassCount,
+      "coalescedMerges" -> frontend.io.coalescedMerges,
+      "contextCacheHits" -> backend.io.contextCacheHits,
+      "contextCacheMisses" -> backend.io.contextCacheMisses,
       "workUnits" -> monWU,
       "contextLoadReq" -> monCLQ,
       "contextStoreReq" -> monCSQ,
@@ -112,6 +176,38 @@ extends GenericAccelerator(p) {
     */
   }
 
+  // channel IDs used on a backend port: the channels routed through the
+  // port get consecutive ID ranges there. context memory writes go out on
+  // the ctxmem-w port with the IDs of the ctxmem-r channel.
+  def chanIDsOnPort(port: Int): Int = {
+    def readIDs(port: Int) = pSeyrek.chanConfig.values.filter(_.port == port).map(_.maxReadTxns).sum
+    if(pSeyrek.chanConfig("ctxmem-w").port == port)
+      math.max(readIDs(port), readIDs(pSeyrek.chanConfig("ctxmem-r").port))
+    else readIDs(port)
+  }
+  // backend clients use the IDs of their port, job queue engines only ID 0
+  def idsOfClient(g: Int): Int = {
+    if(g < numBackendPorts) chanIDsOnPort(g % pSeyrek.portsPerPE) else 1
+  }
+
+  for(mp <- 0 until numMemPorts) {
+    val clientInds = (mp until numMemClients by numMemPorts)
+    val clients = clientInds.map(memClients(_))
+    if(clients.size == 1) {
+      clients(0) <> io.memPort(mp)
+    } else {
+      // each client gets an equal, power-of-two range, large enough for the
+      // client on this port that uses the most IDs
+      val idsPerClient = 1 << log2Up(clientInds.map(idsOfClient(_)).max)
+      if(clients.size * idsPerClient > (1 << pSeyrek.mrp.idWidth))
+        throw new Exception("Not enough channel ID bits to share memory port")
+      val arb = Module(new MemPortArbiter(pSeyrek.mrp, clients.size, idsPerClient)).io
+      for(c <- 0 until clients.size)
+        clients(c) <> arb.clients(c)
+      arb.mem <> io.memPort(mp)
+    }
+  }
+
   // generate a C++ function that returns a mapping from performance counter
   // names to performance counter registers
   def generatePerfCtrMapCode(targetDir: String) = {
@@ -11,18 +11,24 @@ import TidbitsStreams._
 
 class SpMVBackendIO(p: SeyrekParams) extends Bundle with SeyrekCtrlStat {
   val csc = new CSCSpMV(p).asInput
-  // output to frontend
-  val workUnits = Decoupled(p.wu)
+  // output to frontend, one stream per lane
+  val workUnits = Vec.fill(p.frontendLanes) {Decoupled(p.wu)}
   // context init
   val contextReqCnt = UInt(INPUT, 10)
-  // context load port
-  val contextLoadReq = Decoupled(p.vi).flip
-  val contextLoadRsp = Decoupled(p.wu)
-  // context save port
-  val contextSaveReq = Decoupled(p.vi).flip
-  val contextSaveRsp = Decoupled(p.i)
+  val contextInit = UInt(INPUT, width = p.valWidth)
+  // op selection, for the matrix values of selectable pattern-only configs
+  val semiringSel = UInt(INPUT, width = SemiringOps.selWidth)
+  // context load ports, one per lane (context memory bank)
+  val contextLoadReq = Vec.fill(p.frontendLanes) {Decoupled(p.vi).flip}
+  val contextLoadRsp = Vec.fill(p.frontendLanes) {Decoupled(p.wu)}
+  // context save ports
+  val contextSaveReq = Vec.fill(p.frontendLanes) {Decoupled(p.vi).flip}
+  val contextSaveRsp = Vec.fill(p.frontendLanes) {Decoupled(p.i)}
   // memory ports
   val mainMem = Vec.fill(p.portsPerPE) {new GenericMemoryMasterPort(p.mrp)}
+  // context memory cache statistics
+  val contextCacheHits = UInt(OUTPUT, 32)
+  val contextCacheMisses = UInt(OUTPUT, 32)
   // debug - stat
   /*
   val monCP = new StreamMonitorOutIF()
@@ -34,6 +40,16 @@ class SpMVBackendIO(p: SeyrekParams) extends Bundle with SeyrekCtrlStat {
 
 class SpMVBackend(p: SeyrekParams) extends Module {
   val io = new SpMVBackendIO(p)
+  val lanes = p.frontendLanes
+
+  if(lanes > 1) {
+    if((1 << log2Up(lanes)) != lanes)
+      throw new Exception("frontendLanes must be a power of two")
+    if(lanes * math.max(p.valWidth, p.indWidth) > p.mrp.dataWidth)
+      throw new Exception("Lane groups do not fit into one memory beat")
+    if(p.patternOnly)
+      throw new Exception("Multi-lane frontends need the nzdata stream")
+  }
 
   val memsys = Module(new MultiChanMultiPort(p.mrp, p.portsPerPE,
     chans = p.chanConfig))
@@ -43,27 +59,42 @@ class SpMVBackend(p: SeyrekParams) extends Module {
     io.mainMem(i).memRdRsp <> memsys.io.memRsp(i)
   }
 
-  // instantiate the context memory
-  val contextmem = Module(
-    // channel ID base is passed as argument to ctx.mem. constructor
-    p.makeContextMemory(memsys.getChanParams("ctxmem-r"))
-  )
-  contextmem.io.contextReqCnt := io.contextReqCnt
-  contextmem.io.start := io.start
-  contextmem.io.mode := io.mode
-  contextmem.io.contextBase := io.csc.outVec
-  io.contextLoadReq <> contextmem.io.contextLoadReq
-  contextmem.io.contextLoadRsp <> io.contextLoadRsp
-  io.contextSaveReq <> contextmem.io.contextSaveReq
-  contextmem.io.contextSaveRsp <> io.contextSaveRsp
-  memsys.connectChanReqRsp("ctxmem-r", contextmem.io.mainMem.memRdReq,
-    contextmem.io.mainMem.memRdRsp
+  // instantiate the context memory, banked for multi-lane frontends
+  // channel ID base is passed as argument to ctx.mem. constructor
+  val ctxChan = memsys.getChanParams("ctxmem-r")
+  val contextmem: ContextMemCtrlIO = if(lanes == 1) {
+    val cm = Module(p.makeContextMemory(ctxChan)).io
+    io.contextLoadReq(0) <> cm.contextLoadReq
+    cm.contextLoadRsp <> io.contextLoadRsp(0)
+    io.contextSaveReq(0) <> cm.contextSaveReq
+    cm.contextSaveRsp <> io.contextSaveRsp(0)
+    cm
+  } else {
+    val cm = Module(p.makeBankedContextMemory(ctxChan)).io
+    for(b <- 0 until lanes) {
+      io.contextLoadReq(b) <> cm.contextLoadReq(b)
+      cm.contextLoadRsp(b) <> io.contextLoadRsp(b)
+      io.contextSaveReq(b) <> cm.contextSaveReq(b)
+      cm.contextSaveRsp(b) <> io.contextSaveRsp(b)
+    }
+    cm
+  }
+  contextmem.contextReqCnt := io.contextReqCnt
+  contextmem.start := io.start
+  contextmem.mode := io.mode
+  contextmem.contextBase := io.csc.outVec
+  contextmem.contextRows := io.csc.rows
+  contextmem.contextInit := io.contextInit
+  io.contextCacheHits := contextmem.cacheHits
+  io.contextCacheMisses := contextmem.cacheMisses
+  memsys.connectChanReqRsp("ctxmem-r", contextmem.mainMem.memRdReq,
+    contextmem.mainMem.memRdRsp
   )
   // TODO write port sharing? this is the only write so far
   val ctxMemPort = memsys.getChanParams("ctxmem-w").port
-  contextmem.io.mainMem.memWrReq <> io.mainMem(ctxMemPort).memWrReq
-  contextmem.io.mainMem.memWrDat <> io.mainMem(ctxMemPort).memWrDat
-  io.mainMem(ctxMemPort).memWrRsp <> contextmem.io.mainMem.memWrRsp
+  contextmem.mainMem.memWrReq <> io.mainMem(ctxMemPort).memWrReq
+  contextmem.mainMem.memWrDat <> io.mainMem(ctxMemPort).memWrDat
+  io.mainMem(ctxMemPort).memWrRsp <> contextmem.mainMem.memWrRsp
 
 // - if the platform does not return same ID reqs in-order, we need a read
 //   order cache. in this case throttling is not necessary, since the #
@@ -81,8 +112,10 @@ class SpMVBackend(p: SeyrekParams) extends Module {
   )))
   memsys.connectChanReqRsp("colptr", readColPtr.io.req, readColPtr.io.rsp)
 
+  // with several lanes, the rowind and nzdata streams deliver the elements
+  // of all lanes together, lane 0 in the lowest bits
   val readRowInd = Module(new StreamReader(new StreamReaderParams(
-    streamWidth = p.indWidth, fifoElems = 256, mem = p.mrp, maxBeats = 8,
+    streamWidth = lanes * p.indWidth, fifoElems = 256, mem = p.mrp, maxBeats = 8,
     disableThrottle = needReadOrder, readOrderCache = needReadOrder,
     readOrderTxns = memsys.getChanParams("rowind").maxReadTxns,
     chanID = memsys.getChanParams("rowind").chanBaseID,
@@ -90,14 +123,18 @@ class SpMVBackend(p: SeyrekParams) extends Module {
   )))
   memsys.connectChanReqRsp("rowind", readRowInd.io.req, readRowInd.io.rsp)
 
-  val readNZData = Module(new StreamReader(new StreamReaderParams(
-    streamWidth = p.valWidth, fifoElems = 256, mem = p.mrp, maxBeats = 8,
-    disableThrottle = needReadOrder, readOrderCache = needReadOrder,
-    readOrderTxns = memsys.getChanParams("nzdata").maxReadTxns,
-    chanID = memsys.getChanParams("nzdata").chanBaseID,
-    streamName = "nzdata"
-  )))
-  memsys.connectChanReqRsp("nzdata", readNZData.io.req, readNZData.io.rsp)
+  // pattern-only configs have no nzdata channel and no reader for it
+  val readNZData: Option[StreamReader] = if(p.patternOnly) None else {
+    val r = Module(new StreamReader(new StreamReaderParams(
+      streamWidth = lanes * p.valWidth, fifoElems = 256, mem = p.mrp, maxBeats = 8,
+      disableThrottle = needReadOrder, readOrderCache = needReadOrder,
+      readOrderTxns = memsys.getChanParams("nzdata").maxReadTxns,
+      chanID = memsys.getChanParams("nzdata").chanBaseID,
+      streamName = "nzdata"
+    )))
+    memsys.connectChanReqRsp("nzdata", r.io.req, r.io.rsp)
+    Some(r)
+  }
 
   val readInpVec = Module(new StreamReader(new StreamReaderParams(
     streamWidth = p.valWidth, fifoElems = 128, mem = p.mrp, maxBeats = 8,
@@ -108,19 +145,46 @@ class SpMVBackend(p: SeyrekParams) extends Module {
   )))
   memsys.connectChanReqRsp("inpvec", readInpVec.io.req, readInpVec.io.rsp)
 
-  // use the column pointers to generate column lengths with StreamDelta
-  val colLens = StreamDelta(readColPtr.io.out)
-  // repeat each input vector element <colLen> times
-  val repeatedVec = StreamRepeatElem(readInpVec.io.out, colLens)
-  // join up to create the outputs that the frontend expects
-  val nzAndInd = StreamJoin(readNZData.io.out, readRowInd.io.out, p.vi,
-    {(a: UInt, b: UInt) => ValIndPair(a, b)})
-  def makeWorkUnit(vi: ValIndPair, v: UInt): WorkUnit = {
-    WorkUnit(vi.value, v, vi.ind) }
-  StreamJoin(nzAndInd, repeatedVec, p.wu, makeWorkUnit) <> io.workUnits
-
   // control signals for StreamReaders
   val startRegular = (io.mode === SeyrekModes.START_REGULAR) & io.start
+
+  // use the column pointers to generate column lengths with StreamDelta
+  val colLens = StreamDelta(readColPtr.io.out)
+  if(lanes == 1) {
+    // repeat each input vector element <colLen> times
+    val repeatedVec = StreamRepeatElem(readInpVec.io.out, colLens)
+    // join up to create the outputs that the frontend expects
+    val nzAndInd = readNZData match {
+      case Some(r) => StreamJoin(r.io.out, readRowInd.io.out, p.vi,
+        {(a: UInt, b: UInt) => ValIndPair(a, b)})
+      // pair each row index with the semiring one, the identity of the
+      // selected mul op for selectable semirings
+      case None => {
+        val one = if(p.selectableSemiring)
+          SemiringOps.mulOne(p.valWidth, SemiringOps.mulSel(io.semiringSel))
+          else UInt(p.semiringOne, width = p.valWidth)
+        StreamFilter(readRowInd.io.out, p.vi,
+          {b: UInt => ValIndPair(one, b)})
+      }
+    }
+    def makeWorkUnit(vi: ValIndPair, v: UInt): WorkUnit = {
+      WorkUnit(vi.value, v, vi.ind) }
+    StreamJoin(nzAndInd, repeatedVec, p.wu, makeWorkUnit) <> io.workUnits(0)
+  } else {
+    // repeat the input vector elements into lane groups matching the
+    // nzdata and rowind groups, then split into one stream per lane
+    val repeatedVec = Module(new WideRepeatElem(lanes, p.valWidth, p.indWidth)).io
+    repeatedVec.start := startRegular
+    repeatedVec.total := io.csc.nz
+    colLens <> repeatedVec.lens
+    readInpVec.io.out <> repeatedVec.elems
+    val splitter = Module(new LaneSplitter(p)).io
+    readNZData.get.io.out <> splitter.nzData
+    readRowInd.io.out <> splitter.rowInds
+    repeatedVec.out <> splitter.vecVals
+    for(l <- 0 until lanes)
+      splitter.out(l) <> io.workUnits(l)
+  }
   val bytesVal = UInt(p.valWidth / 8)
   val bytesInd = UInt(p.indWidth / 8)
   // TODO these byte widths won't work if we are using non-byte-sized vals/inds
@@ -131,17 +195,23 @@ class SpMVBackend(p: SeyrekParams) extends Module {
 
   readRowInd.io.start := startRegular
   readRowInd.io.baseAddr := io.csc.rowInd
-  readRowInd.io.byteCount := bytesInd * io.csc.nz
-
-  readNZData.io.start := startRegular
-  readNZData.io.baseAddr := io.csc.nzData
-  readNZData.io.byteCount := bytesVal * io.csc.nz
+  // the lane streams are read in whole groups, padding the last one
+  val laneBits = log2Up(lanes)
+  val nzRead = if(lanes == 1) io.csc.nz else
+    ((io.csc.nz + UInt(lanes-1)) >> UInt(laneBits)) << UInt(laneBits)
+  readRowInd.io.byteCount := bytesInd * nzRead
+
+  for(r <- readNZData) {
+    r.io.start := startRegular
+    r.io.baseAddr := io.csc.nzData
+    r.io.byteCount := bytesVal * nzRead
+  }
 
   readInpVec.io.start := startRegular
   readInpVec.io.baseAddr := io.csc.inpVec
   readInpVec.io.byteCount := bytesVal * io.csc.cols
 
-  val seqReaders = Array[StreamReader](readColPtr, readRowInd, readNZData, readInpVec)
+  val seqReaders = Array[StreamReader](readColPtr, readRowInd, readInpVec) ++ readNZData
 
   io.finished := Bool(false)
 
@@ -157,7 +227,7 @@ class SpMVBackend(p: SeyrekParams) extends Module {
 
   io.monCP := StreamMonitor(readColPtr.io.out, enMon)
   io.monRI := StreamMonitor(readRowInd.io.out, enMon)
-  io.monNZ := StreamMonitor(readNZData.io.out, enMon)
+  io.monNZ := StreamMonitor(readNZData.get.io.out, enMon)
   io.monIV := StreamMonitor(readInpVec.io.out, enMon)
   */
 }
@@ -6,15 +6,19 @@ import TidbitsOCM._
 
 class SpMVFrontendIO(p: SeyrekParams) extends Bundle with SeyrekCtrlStat {
   val csc = new CSCSpMV(p).asInput
-  // input from backend
-  val workUnits = Decoupled(p.wu).flip
-  // context access ports
-  val contextLoadReq = Decoupled(p.vi)
-  val contextLoadRsp = Decoupled(p.wu).flip
-  val contextSaveReq = Decoupled(p.vi)
-  val contextSaveRsp = Decoupled(p.i).flip
+  // input from backend, one stream per lane
+  val workUnits = Vec.fill(p.frontendLanes) {Decoupled(p.wu).flip}
+  // context access ports, one set per lane (context memory bank)
+  val contextLoadReq = Vec.fill(p.frontendLanes) {Decoupled(p.vi)}
+  val contextLoadRsp = Vec.fill(p.frontendLanes) {Decoupled(p.wu).flip}
+  val contextSaveReq = Vec.fill(p.frontendLanes) {Decoupled(p.vi)}
+  val contextSaveRsp = Vec.fill(p.frontendLanes) {Decoupled(p.i).flip}
   // statistics
   val hazardStallCycles = UInt(OUTPUT, 32)
+  val bypassCount = UInt(OUTPUT, 32)
+  val coalescedMerges = UInt(OUTPUT, 32)
+  // semiring op selection, see SemiringOps
+  val semiringSel = UInt(INPUT, width = SemiringOps.selWidth)
 }
 
 // "dummy" frontend that only consumes the generated work units and asserts
@@ -24,51 +28,86 @@ class SpMVDummyFrontend(p: SeyrekParams) extends Module {
   val io = new SpMVFrontendIO(p)
 
   io.hazardStallCycles := UInt(0)
-  io.workUnits.ready := Bool(true)
-  io.contextLoadReq.valid := Bool(false)
-  io.contextSaveReq.valid := Bool(false)
-  val regWUCounter = Reg(init = UInt(0, 32))
-  when(io.workUnits.ready & io.workUnits.valid) {
-    regWUCounter := regWUCounter + UInt(1)
+  io.bypassCount := UInt(0)
+  io.coalescedMerges := UInt(0)
+  for(l <- 0 until p.frontendLanes) {
+    io.workUnits(l).ready := Bool(true)
+    io.contextLoadReq(l).valid := Bool(false)
+    io.contextSaveReq(l).valid := Bool(false)
   }
+  val regWUCounter = Reg(init = UInt(0, 32))
+  regWUCounter := regWUCounter + PopCount(io.workUnits.map(w => w.ready & w.valid))
   io.finished := Mux(io.mode === SeyrekModes.START_REGULAR & io.start,
     regWUCounter === io.csc.nz, Reg(next=io.start))
 }
 
 class SpMVFrontend(p: SeyrekParams) extends Module {
   val io = new SpMVFrontendIO(p)
-
-  val mul = Module(new ContextfulSemiringOp(p, p.makeSemiringMul)).io
-  val add = Module(new ContextfulSemiringOp(p, p.makeSemiringAdd)).io
-  val sched = Module(p.makeScheduler())
-
-  io.hazardStallCycles := sched.io.hazardStallCycles
-  sched.io.start := io.start
+  val lanes = p.frontendLanes
 
   // TODO do we really need queues at every step, and how big?
 
-  // (v, v, i) -> [queue] -> [mul] -> (n = v*v, i)
-  FPGAQueue(io.workUnits, 2) <> mul.in
-
-  // (n, i) -> [queue] -> [scheduler]
-  FPGAQueue(mul.out, 2) <> sched.io.instr
-
-  // [scheduler] -> (n, i) -> [load context]
-  FPGAQueue(sched.io.issue, 2) <> io.contextLoadReq
+  // (v, v, i) -> [queue] -> [mul] -> (n = v*v, i), one multiplier per lane
+  val mul = (0 until lanes).map(l => Module(new ContextfulSemiringOp(p,
+    p.makeSemiringMul, SemiringOps.mulFxns)).io)
+  for(l <- 0 until lanes) {
+    mul(l).sel := SemiringOps.mulSel(io.semiringSel)
+    FPGAQueue(io.workUnits(l), 2) <> mul(l).in
+  }
 
-  // [load context] -> (o, n, i) -> [add]
-  FPGAQueue(io.contextLoadRsp, 2) <> add.in
+  // with several lanes, (n, i) -> [crossbar] -> (n, i) for bank i % lanes
+  val bankProducts = if(lanes == 1) Seq(FPGAQueue(mul(0).out, 2)) else {
+    val xbar = Module(new LaneCrossbar(p)).io
+    for(l <- 0 until lanes) { FPGAQueue(mul(l).out, 2) <> xbar.in(l) }
+    (0 until lanes).map(b => FPGAQueue(xbar.out(b), 2))
+  }
 
-  // [add] -> (s = o+n, i) -> [queue] -> [save context]
-  FPGAQueue(add.out, 2) <> io.contextSaveReq
+  // each bank has its own coalescers, scheduler and adder
+  val sched = (0 until lanes).map(b => Module(p.makeScheduler()))
+  val add = (0 until lanes).map(b => Module(new ContextfulSemiringOp(p,
+    p.makeSemiringAdd, SemiringOps.addFxns)).io)
+  val coalescers = (0 until lanes).map(b => (0 until p.coalesceStages).map(
+    i => Module(new SameRowCoalescer(p)).io
+  ))
+
+  for(b <- 0 until lanes) {
+    sched(b).io.start := io.start
+    add(b).sel := SemiringOps.addSel(io.semiringSel)
+
+    // (n, i) -> [queue] -> [same-row coalescers] -> [scheduler]
+    // each coalescer merges adjacent products for the same row
+    var products = bankProducts(b)
+    for(c <- coalescers(b)) {
+      c.start := io.start
+      c.sel := SemiringOps.addSel(io.semiringSel)
+      products <> c.in
+      products = FPGAQueue(c.out, 2)
+    }
+    products <> sched(b).io.instr
+
+    // [scheduler] -> (n, i) -> [load context]
+    FPGAQueue(sched(b).io.issue, 2) <> io.contextLoadReq(b)
+
+    // [load context] -> (o, n, i) -> [add]
+    FPGAQueue(io.contextLoadRsp(b), 2) <> add(b).in
+
+    // [add] -> (s = o+n, i) -> [queue] -> [save context]
+    FPGAQueue(add(b).out, 2) <> io.contextSaveReq(b)
+
+    // signal completion to remove from scheduler
+    // [save context] -> i -> [scheduler]
+    FPGAQueue(io.contextSaveRsp(b), 2) <> sched(b).io.compl
+  }
 
-  // signal completion to remove from scheduler
-  // [save context] -> i -> [scheduler]
-  FPGAQueue(io.contextSaveRsp, 2) <> sched.io.compl
+  io.hazardStallCycles := sched.map(s => s.io.hazardStallCycles).reduce(_ + _)
+  io.bypassCount := sched.map(s => s.io.bypassCount).reduce(_ + _)
+  val totalMerges = coalescers.flatten.map(c => c.merges).foldLeft(UInt(0, 32))(_ + _)
+  io.coalescedMerges := totalMerges
 
   // completion logic and statistics
   io.finished := Bool(false)
   val regCompletedOps = Reg(init = UInt(0, 32))
+  val completions = PopCount(sched.map(s => s.io.compl.ready & s.io.compl.valid))
 
   val sIdle :: sRunning :: sFinished :: Nil = Enum(UInt(), 3)
   val regState = Reg(init = UInt(sIdle))
@@ -83,10 +122,9 @@ class SpMVFrontend(p: SeyrekParams) extends Module {
 
       is(sRunning) {
         // count completed operations
-        when (sched.io.compl.ready & sched.io.compl.valid) {
-          regCompletedOps := regCompletedOps + UInt(1)
-        }
-        when (regCompletedOps === io.csc.nz) { regState := sFinished }
+        regCompletedOps := regCompletedOps + completions
+        // merged products never reach the context memory
+        when (regCompletedOps + totalMerges === io.csc.nz) { regState := sFinished }
       }
 
       is(sFinished) {
@@ -9,6 +9,8 @@ class TestBRAMContextMem(p: PlatformWrapperParams) extends GenericAccelerator(p)
   val numMemPorts = 1
   val io = new GenericAcceleratorIF(numMemPorts, p) with SeyrekCtrlStat {
     val contextBase = UInt(INPUT, 64)
+    val contextRows = UInt(INPUT, 32)
+    val contextInit = UInt(INPUT, 32)
   }
   io.signature := makeDefaultSignature()
 
@@ -24,5 +26,7 @@ class TestBRAMContextMem(p: PlatformWrapperParams) extends GenericAccelerator(p)
   inst.contextSaveRsp.ready := Bool(false)
 
   inst.contextBase := io.contextBase
+  inst.contextRows := io.contextRows
+  inst.contextInit := io.contextInit
   inst <> io
 }